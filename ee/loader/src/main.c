@@ -200,6 +200,7 @@ struct SSystemSettings {
     int eecore_mod_base;
 
     int fs_sectors;
+    int ra_sectors;
 
     union {
         uint8_t ilink_id[8];
@@ -787,6 +788,7 @@ int load_driver(const char * type, const char * subtype)
     toml_int_in_overwrite   (tbl_root, "eecore_mod_base", &sys.eecore_mod_base);
 
     toml_int_in_overwrite   (tbl_root, "cdvdman_fs_sectors", &sys.fs_sectors);
+    toml_int_in_overwrite   (tbl_root, "cdvdman_ra_sectors", &sys.ra_sectors);
 
     arr = toml_array_in(tbl_root, "ilink_id");
     if (arr != NULL) {
@@ -869,12 +871,18 @@ void *modlist_get_settings_by_func(struct SModList *ml, const char *func)
     return settings;
 }
 
+#define FRAGLIST_MAX 1024
 int fhi_bd_defrag_add_file_by_fd(struct fhi_bd_defrag *bdm, int fhi_fid, int fd)
 {
-    int i, iop_fd;
+    static bd_fragment_t frags[FRAGLIST_MAX];
+    int i, iop_fd, frag_count;
     off_t size;
-    unsigned int frag_start = 0;
+    unsigned int ext_start = 0;
+    unsigned int ext_count = 0;
+    uint32_t end = 0;
+    uint64_t next_sector = 0;
     struct fhi_bd_defrag_info *frag = &bdm->file[fhi_fid];
+    struct fhi_bd_defrag_extent *ext;
 
     // Get actual IOP fd
     iop_fd = ps2sdk_get_iop_fd(fd);
@@ -882,25 +890,54 @@ int fhi_bd_defrag_add_file_by_fd(struct fhi_bd_defrag *bdm, int fhi_fid, int fd)
     // Get file size
     size = lseek64(fd, 0, SEEK_END);
 
-    // Get current frag use count
+    // Get current extent use count
     for (i = 0; i < FHI_MAX_FILES; i++)
-        frag_start += bdm->file[i].frag_count;
+        ext_start += bdm->file[i].ext_count;
 
-    // Set fragment file
-    frag->frag_start = frag_start;
-    frag->frag_count = fileXioIoctl2(iop_fd, USBMASS_IOCTL_GET_FRAGLIST, NULL, 0, (void *)&bdm->frags[frag->frag_start], sizeof(bd_fragment_t) * (BDM_MAX_FRAGS - frag->frag_start));
-    frag->size = size;
-
-    // Check for max fragments
-    if ((frag->frag_start + frag->frag_count) > BDM_MAX_FRAGS) {
-        printf("Too many fragments (%d)\n", frag->frag_start + frag->frag_count);
+    // Get fragment list
+    frag_count = fileXioIoctl2(iop_fd, USBMASS_IOCTL_GET_FRAGLIST, NULL, 0, (void *)frags, sizeof(frags));
+    if (frag_count < 0 || frag_count > FRAGLIST_MAX) {
+        printf("Too many fragments (%d)\n", frag_count);
         return -1;
     }
 
+    // Extents are stored relative to the lowest sector of the file
+    frag->sector_base = 0;
+    for (i = 0; i < frag_count; i++) {
+        if (i == 0 || frags[i].sector < frag->sector_base)
+            frag->sector_base = frags[i].sector;
+    }
+
+    // Merge adjacent fragments into extents with cumulative file offsets
+    ext = &bdm->extents[ext_start];
+    for (i = 0; i < frag_count; i++) {
+        if ((frags[i].sector - frag->sector_base) > 0xffffffff || ((uint64_t)end + frags[i].count) > 0xffffffff) {
+            printf("File too large\n");
+            return -1;
+        }
+
+        if (ext_count > 0 && frags[i].sector == next_sector) {
+            ext[ext_count - 1].end += frags[i].count;
+        } else {
+            if ((ext_start + ext_count) >= BDM_MAX_EXTENTS) {
+                printf("Too many fragments (%d), max %d extents\n", frag_count, BDM_MAX_EXTENTS - ext_start);
+                return -1;
+            }
+            ext[ext_count].sector = frags[i].sector - frag->sector_base;
+            ext[ext_count].end = end + frags[i].count;
+            ext_count++;
+        }
+        end += frags[i].count;
+        next_sector = frags[i].sector + frags[i].count;
+    }
+    frag->ext_start = ext_start;
+    frag->ext_count = ext_count;
+    frag->size = size;
+
     // Debug info
-    printf("file[%d] fragments: start=%u, count=%u\n", fhi_fid, frag->frag_start, frag->frag_count);
-    for (i=0; i<frag->frag_count; i++)
-        printf("- frag[%d] start=%u, count=%u\n", i, (unsigned int)bdm->frags[frag->frag_start+i].sector, bdm->frags[frag->frag_start+i].count);
+    printf("file[%d] fragments: %d, extents: start=%u, count=%u\n", fhi_fid, frag_count, frag->ext_start, frag->ext_count);
+    for (i = 0; i < frag->ext_count; i++)
+        printf("- ext[%d] start=%u, end=%u\n", i, (unsigned int)(frag->sector_base + ext[i].sector), (unsigned int)ext[i].end);
 
     // Set BDM driver name and number
     // NOTE: can be set only once! Check?
@@ -1297,8 +1334,11 @@ int main(int argc, char *argv[])
 
     // Load module settings for fhi_bd_defrag backing store
     struct fhi_bd_defrag *set_fhi_bd_defrag = modlist_get_settings_by_func(&drv.mod, "FHI_BD");
-    if (set_fhi_bd_defrag != NULL)
+    if (set_fhi_bd_defrag != NULL) {
         memset((void *)set_fhi_bd_defrag, 0, sizeof(struct fhi_bd_defrag));
+        set_fhi_bd_defrag->sched_flags = FHI_SCHED_DEFAULT;
+        set_fhi_bd_defrag->write_chunk = FHI_WRITE_CHUNK_DEFAULT;
+    }
 
     // Load module settings for fhi_fileid backing store
     struct fhi_fileid *set_fhi_fileid = modlist_get_settings_by_func(&drv.mod, "FHI_FILEID");
@@ -1414,6 +1454,7 @@ int main(int argc, char *argv[])
         set_cdvdman->media = eMediaType;
         set_cdvdman->layer1_start = layer1_lba_start;
         set_cdvdman->fs_sectors = sys.fs_sectors;
+        set_cdvdman->ra_sectors = sys.ra_sectors;
         if (sys.ilink_id_int != 0) {
             printf("Overriding i.Link ID: %2x %2x %2x %2x %2x %2x %2x %2x\n"
             , sys.ilink_id[0]
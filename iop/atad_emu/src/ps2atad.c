@@ -85,14 +85,14 @@ int ata_device_sector_io(int device, void *buf, u32 lba, u32 nsectors, int dir)
     M_DEBUG("(%d, 0x%x, %d, %d, %d)\n", device, buf, lba, nsectors, dir);
 
     if (dir == ATA_DIR_WRITE) {
-        fhi_write(FHI_FID_ATA0, buf, lba, nsectors);
-        return 0;
+        if (fhi_write(FHI_FID_ATA0, buf, lba, nsectors) != nsectors)
+            return -1;
     } else {
-        fhi_read(FHI_FID_ATA0, buf, lba, nsectors);
-        return 0;
+        if (fhi_read(FHI_FID_ATA0, buf, lba, nsectors) != nsectors)
+            return -1;
     }
 
-    return -1;
+    return 0;
 }
 
 /* Export 10 */
@@ -213,11 +213,16 @@ static void cdvdfsv_rpc1_th(void *args)
 //-------------------------------------------------------------------------
 static void cdvdfsv_rpc2_th(void *args)
 {
+    int queue = 1;
+
     // Starts NCMD rpc server
     // Starts Search file rpc server
 
     M_DEBUG("%s\n", __FUNCTION__);
 
+    // The NCMD reads read ahead into the FSV buffer, let them wait behind streaming and other reads instead of failing
+    sceCdSC(CDSC_QUEUE_READS, &queue);
+
     sceSifSetRpcQueue(&rpc2_DQ, GetThreadId());
 
     cdvdfsv_register_ncmd_rpc(&rpc2_DQ);
@@ -51,6 +51,9 @@ typedef struct
     u8 buf2[64];
 } cdvdfsv_readee_t;
 
+// cdvd_readiopm reports the read position to EE every time it has advanced this many bytes
+#define CDVDFSV_READPOS_STEP (16 * 2048)
+
 static sceCdRMode cdvdfsv_Stmode;
 
 static SifRpcServerData_t cdvdNcmds_rpcSD;
@@ -98,14 +101,39 @@ enum CDVD_ST_CMDS {
     CDVD_ST_CMD_SEEKF
 };
 
+//--------------------------------------------------------------
+// Start reading the next chunk for cdvd_readee. When the EE buffer is not 64-byte aligned,
+// one extra sector is read: its data is used to correct the buffer alignment.
+static int cdvd_readee_chunk(u32 lsn, u32 sectors_to_read, u32 chunk_sectors, int flag_64b, void *fsvRbuf, u32 *nsectors)
+{
+    int fsverror;
+
+    if (flag_64b == 0) { // not 64 bytes aligned buf
+        *nsectors = (sectors_to_read < chunk_sectors - 1) ? sectors_to_read : (chunk_sectors - 1);
+        if (sceCdRead(lsn, *nsectors + 1, fsvRbuf, NULL) != 0)
+            return 1;
+    } else { // 64 bytes aligned buf
+        *nsectors = (sectors_to_read < chunk_sectors) ? sectors_to_read : chunk_sectors;
+        if (sceCdRead(lsn, *nsectors, fsvRbuf, NULL) != 0)
+            return 1;
+    }
+
+    if (sceCdGetError() == SCECdErNO) {
+        fsverror = SCECdErREADCF;
+        sceCdSC(CDSC_SET_ERROR, &fsverror);
+    }
+
+    return 0;
+}
+
 //--------------------------------------------------------------
 static inline void cdvd_readee(void *buf)
 { // Read Disc data to EE mem buffer
     u8 curlsn_buf[16];
-    u32 nbytes, nsectors, sectors_to_read, size_64b, size_64bb, bytesent, temp;
+    u32 nbytes, nsectors, next_nsectors, chunk_sectors, sectors_to_read, size_64b, size_64bb, bytesent, temp;
     u16 sector_size;
-    int flag_64b, fsverror;
-    void *fsvRbuf = (void *)cdvdfsv_buf;
+    int flag_64b, cur, pipelined, read_ok;
+    void *fsvRbuf[2];
     void *eeaddr_64b, *eeaddr2_64b;
     cdvdfsv_readee_t readee;
     RpcCdvd_t *r = (RpcCdvd_t *)buf;
@@ -150,7 +178,6 @@ static inline void cdvd_readee(void *buf)
     temp -= (u32)eeaddr2_64b;
     readee.pdst2 = eeaddr2_64b; // get the end address on a 64 bytes align
     readee.b2len = temp;        // get bytes remainder at end of 64 bytes align
-    fsvRbuf += temp;
 
     if (readee.b1len)
         flag_64b = 0; // 64 bytes alignment flag
@@ -161,74 +188,84 @@ static inline void cdvd_readee(void *buf)
             flag_64b = 1;
     }
 
+    // Split the buffer in two halves: while one chunk is sent to EE, the next chunk is read into the other half.
+    // The halves are sized in sectors of the requested size, so a 2328/2340 byte chunk doesn't run into the other half.
+    // The unaligned case needs at least 2 sectors per chunk, so small buffers are not split.
+    chunk_sectors = (cdvdfsv_sectors * 2048 / 2) / sector_size;
+    pipelined = (chunk_sectors >= 2);
+    if (!pipelined)
+        chunk_sectors = cdvdfsv_sectors;
+    fsvRbuf[0] = (void *)cdvdfsv_buf + temp;
+    fsvRbuf[1] = fsvRbuf[0] + chunk_sectors * sector_size;
+    cur = 0;
+
+    if (cdvd_readee_chunk(r->lsn, sectors_to_read, chunk_sectors, flag_64b, fsvRbuf[cur], &nsectors) == 0) {
+        *(int *)buf = bytesent;
+        return;
+    }
+
     while (1) {
-        do {
-            if ((sectors_to_read == 0) || (sceCdGetError() == SCECdErABRT)) {
-                sysmemSendEE((void *)&readee, (void *)r->eeaddr1, sizeof(cdvdfsv_readee_t));
+        sceCdSync(0);
 
-                *((u32 *)&curlsn_buf[0]) = nbytes;
-                sysmemSendEE((void *)curlsn_buf, (void *)r->eeaddr2, 16);
+        if (sceCdGetError() == SCECdErABRT)
+            break;
 
-                *(int *)buf = nbytes;
-                return;
-            }
+        // Start reading the next chunk before sending this one
+        read_ok = 1;
+        next_nsectors = 0;
+        if (pipelined && (sectors_to_read > nsectors))
+            read_ok = cdvd_readee_chunk(r->lsn + nsectors, sectors_to_read - nsectors, chunk_sectors, flag_64b, fsvRbuf[cur ^ 1], &next_nsectors);
 
-            if (flag_64b == 0) { // not 64 bytes aligned buf
-                // The data of the last sector of the chunk will be used to correct buffer alignment.
-                if (sectors_to_read < cdvdfsv_sectors - 1)
-                    nsectors = sectors_to_read;
-                else
-                    nsectors = cdvdfsv_sectors - 1;
-                temp = nsectors + 1;
-            } else { // 64 bytes aligned buf
-                if (sectors_to_read < cdvdfsv_sectors)
-                    nsectors = sectors_to_read;
-                else
-                    nsectors = cdvdfsv_sectors;
-                temp = nsectors;
-            }
+        size_64b = nsectors * sector_size;
+        size_64bb = size_64b;
 
-            if (sceCdRead(r->lsn, temp, (void *)fsvRbuf, NULL) == 0) {
-                if (sceCdGetError() == SCECdErNO) {
-                    fsverror = SCECdErREADCF;
-                    sceCdSC(CDSC_SET_ERROR, &fsverror);
-                }
+        if (!flag_64b) {
+            if (sectors_to_read == r->sectors) // check that was the first read. Data read will be skewed by readee.b1len bytes into the adjacent sector.
+                memcpy((void *)readee.buf1, fsvRbuf[cur], readee.b1len);
 
-                *(int *)buf = bytesent;
-                return;
-            }
-            sceCdSync(0);
+            if ((sectors_to_read == nsectors) && (readee.b1len)) // For the last sector read.
+                size_64bb = size_64b - 64;
+        }
 
-            size_64b = nsectors * sector_size;
-            size_64bb = size_64b;
+        if (size_64bb > 0) {
+            sysmemSendEE(fsvRbuf[cur] + readee.b1len, (void *)eeaddr_64b, size_64bb);
+            bytesent += size_64bb;
+        }
 
-            if (!flag_64b) {
-                if (sectors_to_read == r->sectors) // check that was the first read. Data read will be skewed by readee.b1len bytes into the adjacent sector.
-                    memcpy((void *)readee.buf1, (void *)fsvRbuf, readee.b1len);
+        *((u32 *)&curlsn_buf[0]) = bytesent;
+        sysmemSendEE((void *)curlsn_buf, (void *)r->eeaddr2, 16);
 
-                if ((sectors_to_read == nsectors) && (readee.b1len)) // For the last sector read.
-                    size_64bb = size_64b - 64;
-            }
+        sectors_to_read -= nsectors;
+        r->lsn += nsectors;
+        eeaddr_64b += size_64b;
 
-            if (size_64bb > 0) {
-                sysmemSendEE((void *)(fsvRbuf + readee.b1len), (void *)eeaddr_64b, size_64bb);
-                bytesent += size_64bb;
-            }
+        if (sectors_to_read == 0) {
+            // At the very last pass, copy readee.b2len bytes from the last sector, to complete the alignment correction.
+            if (!flag_64b)
+                memcpy((void *)readee.buf2, fsvRbuf[cur] + size_64b - readee.b2len, readee.b2len);
+            break;
+        }
 
-            *((u32 *)&curlsn_buf[0]) = bytesent;
-            sysmemSendEE((void *)curlsn_buf, (void *)r->eeaddr2, 16);
+        if (!pipelined) {
+            if (sceCdGetError() == SCECdErABRT)
+                break;
+            read_ok = cdvd_readee_chunk(r->lsn, sectors_to_read, chunk_sectors, flag_64b, fsvRbuf[cur], &next_nsectors);
+        } else
+            cur ^= 1;
 
-            sectors_to_read -= nsectors;
-            r->lsn += nsectors;
-            eeaddr_64b += size_64b;
+        if (!read_ok) {
+            *(int *)buf = bytesent;
+            return;
+        }
+        nsectors = next_nsectors;
+    }
 
-        } while ((flag_64b) || (sectors_to_read));
+    sysmemSendEE((void *)&readee, (void *)r->eeaddr1, sizeof(cdvdfsv_readee_t));
 
-        // At the very last pass, copy readee.b2len bytes from the last sector, to complete the alignment correction.
-        memcpy((void *)readee.buf2, (void *)(fsvRbuf + size_64b - readee.b2len), readee.b2len);
-    }
+    *((u32 *)&curlsn_buf[0]) = nbytes;
+    sysmemSendEE((void *)curlsn_buf, (void *)r->eeaddr2, 16);
 
-    *(int *)buf = bytesent;
+    *(int *)buf = nbytes;
 }
 
 //-------------------------------------------------------------------------
@@ -292,16 +329,29 @@ static inline void cdvd_Stsubcmdcall(void *buf)
 
 static inline void cdvd_readiopm(void *buf)
 {
-    int r, fsverror;
-    u32 readpos;
+    int r, fsverror, cdvdman_intr_ef, dummy;
+    u32 readpos, reported;
 
     M_DEBUG("%s\n", __FUNCTION__);
 
+    cdvdman_intr_ef = sceCdSC(CDSC_GET_INTRFLAG, &dummy);
+
     r = sceCdRead(((RpcCdvd_t *)buf)->lsn, ((RpcCdvd_t *)buf)->sectors, ((RpcCdvd_t *)buf)->buf, NULL);
-    while (sceCdSync(1)) {
+
+    // The read thread signals every time the read position advances, and when the read completes.
+    // Clear the flag before checking, so a signal in between is not missed.
+    for (reported = 0;;) {
+        ClearEventFlag(cdvdman_intr_ef, ~CDVDEF_READ_POS);
+        if (sceCdSync(1) == 0)
+            break;
+
         readpos = sceCdGetReadPos();
-        sysmemSendEE(&readpos, ((RpcCdvd_t *)buf)->eeaddr2, sizeof(readpos));
-        DelayThread(8000);
+        if (readpos >= reported + CDVDFSV_READPOS_STEP) {
+            sysmemSendEE(&readpos, ((RpcCdvd_t *)buf)->eeaddr2, sizeof(readpos));
+            reported = readpos;
+        }
+
+        WaitEventFlag(cdvdman_intr_ef, CDVDEF_READ_POS, WEF_AND, NULL);
     }
 
     if (r == 0) {
@@ -312,63 +362,134 @@ static inline void cdvd_readiopm(void *buf)
     }
 }
 
+//-------------------------------------------------------------------------
+static int cdvd_readchain_start(u32 lsn, u32 sectors, void *buf, int fsverror)
+{
+    if (sceCdRead(lsn, sectors, buf, NULL) != 0)
+        return 1;
+
+    if (sceCdGetError() == SCECdErNO)
+        sceCdSC(CDSC_SET_ERROR, &fsverror);
+
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+// Read a run of chain entries with contiguous sectors to EE RAM. The run is read in chunks,
+// alternating between the two halves of the FSV buffer, so the next chunk is read while this one is sent.
+static int cdvd_readchain_ee(RpcCdvdchain_t *ch, u32 lsn, u32 sectors, u32 *readpos, void *readpos_addr)
+{
+    u32 chunk_sectors, nsectors, next_nsectors, remaining, offset, n;
+    int cur, pipelined;
+    u8 *fsvRbuf[2], *src;
+
+    pipelined = (cdvdfsv_sectors >= 2);
+    chunk_sectors = pipelined ? (cdvdfsv_sectors / 2) : cdvdfsv_sectors;
+    fsvRbuf[0] = cdvdfsv_buf;
+    fsvRbuf[1] = cdvdfsv_buf + chunk_sectors * 2048;
+    cur = 0;
+    offset = 0; // Sectors of the current entry that have been sent
+
+    nsectors = (sectors > chunk_sectors) ? chunk_sectors : sectors;
+    if (!cdvd_readchain_start(lsn, nsectors, fsvRbuf[cur], SCECdErREADCF))
+        return 0;
+
+    while (1) {
+        sceCdSync(0);
+
+        // Start reading the next chunk before sending this one
+        next_nsectors = ((sectors - nsectors) > chunk_sectors) ? chunk_sectors : (sectors - nsectors);
+        if (pipelined && (next_nsectors > 0)) {
+            if (!cdvd_readchain_start(lsn + nsectors, next_nsectors, fsvRbuf[cur ^ 1], SCECdErREADCF))
+                return 0;
+        }
+
+        // Scatter the chunk over the entries it covers
+        for (src = fsvRbuf[cur], remaining = nsectors; remaining > 0; src += n * 2048, remaining -= n) {
+            while (offset == ch->sectors) {
+                ch++;
+                offset = 0;
+            }
+
+            n = ch->sectors - offset;
+            if (n > remaining)
+                n = remaining;
+            sysmemSendEE(src, (void *)(((u32)ch->buf & 0xfffffffc) + offset * 2048), n * 2048);
+            offset += n;
+        }
+
+        *readpos += nsectors * 2048;
+        sysmemSendEE(readpos, readpos_addr, sizeof(*readpos));
+
+        lsn += nsectors;
+        sectors -= nsectors;
+        if (sectors == 0)
+            return 1;
+
+        if (!pipelined) {
+            if (!cdvd_readchain_start(lsn, next_nsectors, fsvRbuf[cur], SCECdErREADCF))
+                return 0;
+        } else
+            cur ^= 1;
+        nsectors = next_nsectors;
+    }
+}
+
 //-------------------------------------------------------------------------
 static inline void cdvd_readchain(void *buf)
 {
-    int i, fsverror;
-    u32 nsectors, tsectors, lsn, addr, readpos;
+    int count, first, last;
+    u32 sectors, lsn, addr, readpos;
+    void *readpos_addr;
 
     RpcCdvdchain_t *ch = (RpcCdvdchain_t *)buf;
 
     M_DEBUG("%s\n", __FUNCTION__);
 
-    for (i = 0, readpos = 0; i < 64; i++, ch++) {
+    // The pointer to the read position variable within EE RAM is stored at ((RpcCdvdchain_t *)buf)[65].sectors.
+    readpos_addr = (void *)ch[65].sectors;
 
-        if ((ch->lsn == -1) || (ch->sectors == -1) || ((u32)ch->buf == -1))
+    for (count = 0; count < 64; count++) {
+        if ((ch[count].lsn == -1) || (ch[count].sectors == -1) || ((u32)ch[count].buf == -1))
             break;
+    }
+
+    for (first = 0, readpos = 0; first < count; first = last + 1) {
+        lsn = ch[first].lsn;
+        sectors = ch[first].sectors;
+        addr = (u32)ch[first].buf & 0xfffffffc;
+
+        // Merge the following entries that continue on the next sector into one run.
+        // IOP entries are read straight into their buffer, so their buffers must be contiguous too.
+        for (last = first; last + 1 < count; last++) {
+            RpcCdvdchain_t *next = &ch[last + 1];
+
+            if ((((u32)next->buf ^ (u32)ch[first].buf) & 1) || (next->lsn != lsn + sectors))
+                break;
+            if (((u32)ch[first].buf & 1) && (((u32)next->buf & 0xfffffffc) != addr + sectors * 2048))
+                break;
 
-        lsn = ch->lsn;
-        tsectors = ch->sectors;
-        addr = (u32)ch->buf & 0xfffffffc;
+            sectors += next->sectors;
+        }
 
-        if ((u32)ch->buf & 1) { // IOP addr
-            if (sceCdRead(lsn, tsectors, (void *)addr, NULL) == 0) {
-                if (sceCdGetError() == SCECdErNO) {
-                    fsverror = SCECdErREADCFR;
-                    sceCdSC(CDSC_SET_ERROR, &fsverror);
-                }
+        if (sectors == 0)
+            continue;
 
+        if ((u32)ch[first].buf & 1) { // IOP addr
+            if (!cdvd_readchain_start(lsn, sectors, (void *)addr, SCECdErREADCFR)) {
                 *(int *)buf = 0;
                 return;
             }
             sceCdSync(0);
 
-            readpos += tsectors * 2048;
+            readpos += sectors * 2048;
+            sysmemSendEE(&readpos, readpos_addr, sizeof(readpos));
         } else { // EE addr
-            while (tsectors > 0) {
-                nsectors = (tsectors > cdvdfsv_sectors) ? cdvdfsv_sectors : tsectors;
-
-                if (sceCdRead(lsn, nsectors, cdvdfsv_buf, NULL) == 0) {
-                    if (sceCdGetError() == SCECdErNO) {
-                        fsverror = SCECdErREADCF;
-                        sceCdSC(CDSC_SET_ERROR, &fsverror);
-                    }
-
-                    *(int *)buf = 0;
-                    return;
-                }
-                sceCdSync(0);
-                sysmemSendEE(cdvdfsv_buf, (void *)addr, nsectors * 2048);
-
-                lsn += nsectors;
-                tsectors -= nsectors;
-                addr += nsectors * 2048;
-                readpos += nsectors * 2048;
+            if (!cdvd_readchain_ee(&ch[first], lsn, sectors, &readpos, readpos_addr)) {
+                *(int *)buf = 0;
+                return;
             }
         }
-
-        // The pointer to the read position variable within EE RAM is stored at ((RpcCdvdchain_t *)buf)[65].sectors.
-        sysmemSendEE(&readpos, (void *)((RpcCdvdchain_t *)buf)[65].sectors, sizeof(readpos));
     }
 }
 
@@ -153,10 +153,16 @@ int sceCdSC(int code, int *param)
             result = cdvdman_stat.intr_ef;
             break;
         case CDSC_IO_SEMA:
+            // CDVDFSV reads into the FSV buffer while it holds the I/O semaphore.
+            // The buffer is also the sector window, lock it and forget its contents.
             if (*param) {
                 WaitSema(cdrom_io_sema);
-            } else
+                WaitSema(cdvdman_searchfilesema);
+                cdvdman_window_invalidate();
+            } else {
+                SignalSema(cdvdman_searchfilesema);
                 SignalSema(cdrom_io_sema);
+            }
 
             result = *param; // EE N-command code.
             break;
@@ -170,6 +176,10 @@ int sceCdSC(int code, int *param)
         case CDSC_SET_ERROR:
             result = cdvdman_stat.err = *param;
             break;
+        case CDSC_QUEUE_READS:
+            cdvdman_read_set_queue_thread(*param ? GetThreadId() : 0);
+            result = 1;
+            break;
         default:
             M_DEBUG("%s(0x%X, 0x%X) unknown code\n", __FUNCTION__, code, *param);
             result = 1; // dummy result
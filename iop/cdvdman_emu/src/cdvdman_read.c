@@ -7,18 +7,188 @@
 #include "cdvdman_read.h"
 
 
+// Maximum number of read requests that can be pending at the same time
+#define CDVDMAN_READ_QUEUE_SIZE 8
+// Read-ahead device read size, new requests are checked for in between
+#define CDVDMAN_RA_CHUNK 16
+
 static int cdrom_rthread_sema;
 static StmCallback_t Stm0Callback = NULL;
+static volatile StmCallback_t DeferredCallback = NULL;
 static unsigned int ReadPos = 0; /* Current buffer offset in 2048-byte sectors. */
 static int cdvdman_ReadingThreadID;
 volatile unsigned char sync_flag_locked;
+volatile unsigned int cdvdman_read_others_pending; // Pending requests that are not from streaming
+struct cdvdman_read_stats cdvdman_read_stats;
+
+// Bounce buffer, only used by the read thread for the last sector of unaligned reads
+static u8 cdvdman_bounce_buf[CDVDMAN_BUF_SECTORS * 2048];
+
+// Read-ahead cache, filled after sequential reads when no other requests are pending
+static u8 *ra_buf = NULL;
+static u32 ra_lsn;            // First sector in the cache
+static unsigned int ra_count; // Number of valid sectors in the cache
+static u32 ra_next_lsn;       // Sector following the previous request, used to detect sequential reads
+
+// Pending read requests, processed in order by the read thread
+static cdvdman_read_t read_queue[CDVDMAN_READ_QUEUE_SIZE];
+static unsigned int read_queue_head;      // Request currently being processed
+static unsigned int read_queue_count;     // Number of pending requests, including the one being processed
+static u32 read_queue_submitted;          // Ticket of the last queued request
+static volatile u32 read_queue_completed; // Ticket of the last completed request
+static int read_queue_ef;                 // One bit per queue entry, set when the entry is free or completed
+static int read_queue_thid;               // Thread whose sceCdRead calls are queued while busy (CDVDFSV)
+
+
+// Accurate reads timing, shared with the alarm handler.
+// The emulated time runs in windows of up to 8 sectors. The device reads are done in chunks of
+// the same size, and run at most one chunk ahead of the emulated time.
+static struct
+{
+    u32 clock_per_sector;        // Emulated time of a single sector, in system clock ticks
+    unsigned int pos_base;       // ReadPos when the request started
+    unsigned int sectors;        // Total number of sectors to time
+    unsigned int window;         // Number of sectors in the running timing window
+    volatile unsigned int timed; // Sectors for which the emulated time has passed
+    volatile unsigned int read;  // Sectors read from the device
+} read_timing;
 
+//-------------------------------------------------------------------------
+// Must be called from an interrupt-disabled state.
+static void cdvdman_read_timing_update_pos(void)
+{
+    // Never report more data than a real drive would have read by now
+    ReadPos = read_timing.pos_base + ((read_timing.timed < read_timing.read) ? read_timing.timed : read_timing.read) * 2048;
+}
 
 //-------------------------------------------------------------------------
 static unsigned int cdvdman_read_sectors_end_cb(void *arg)
 {
-    iSetEventFlag(cdvdman_stat.intr_ef, CDVDEF_READ_END);
-    return 0;
+    unsigned int remaining;
+
+    read_timing.timed += read_timing.window;
+    cdvdman_read_timing_update_pos();
+
+    remaining = read_timing.sectors - read_timing.timed;
+    if (remaining == 0) {
+        iSetEventFlag(cdvdman_stat.intr_ef, CDVDEF_READ_END | CDVDEF_READ_TIMED | CDVDEF_READ_POS);
+        return 0;
+    }
+    iSetEventFlag(cdvdman_stat.intr_ef, CDVDEF_READ_TIMED | CDVDEF_READ_POS);
+
+    // Re-arm the alarm for the next window
+    read_timing.window = (remaining > 8) ? 8 : remaining;
+    return read_timing.clock_per_sector * read_timing.window;
+}
+
+//-------------------------------------------------------------------------
+static int cdvdman_read_device(u32 lsn, void *buf, unsigned int sectors)
+{
+    unsigned int cached;
+
+    // Serve the first part of the request from the read-ahead cache
+    if ((ra_count > 0) && (lsn >= ra_lsn) && (lsn < (ra_lsn + ra_count))) {
+        cached = ra_lsn + ra_count - lsn;
+        if (cached > sectors)
+            cached = sectors;
+
+        memcpy(buf, &ra_buf[(lsn - ra_lsn) * 2048], cached * 2048);
+        cdvdman_read_stats.ra_sectors += cached;
+        lsn += cached;
+        buf = (void *)((u8 *)buf + (cached * 2048));
+        sectors -= cached;
+    }
+
+    if (sectors == 0)
+        return SCECdErNO;
+
+    return DeviceReadSectors(lsn, buf, sectors);
+}
+
+//-------------------------------------------------------------------------
+static int cdvdman_stats_log2(u32 value)
+{
+    int bin = 0;
+
+    while (value >>= 1)
+        bin++;
+
+    return bin;
+}
+
+//-------------------------------------------------------------------------
+static void cdvdman_stats_add(struct cdvdman_read_stats_counter *counter, u32 sectors, u32 usec)
+{
+    counter->requests++;
+    counter->sectors += sectors;
+    counter->usec += usec;
+}
+
+//-------------------------------------------------------------------------
+// Account a completed request, called by the read thread
+static void cdvdman_stats_request(const cdvdman_read_t *req, int bounce, u32 clocks)
+{
+    iop_sys_clock_t clk;
+    u32 sec, usec;
+    int bin, OldState;
+
+    clk.lo = clocks;
+    clk.hi = 0;
+    SysClock2USec(&clk, &sec, &usec);
+    usec += sec * 1000000;
+
+    CpuSuspendIntr(&OldState);
+    cdvdman_stats_add(&cdvdman_read_stats.source[req->source], req->sectors, usec);
+
+    bin = cdvdman_stats_log2(req->sectors);
+    cdvdman_stats_add(&cdvdman_read_stats.size[(bin < CDVDMAN_STATS_SIZES) ? bin : (CDVDMAN_STATS_SIZES - 1)], req->sectors, usec);
+
+    cdvdman_stats_add(bounce ? &cdvdman_read_stats.bounce : &cdvdman_read_stats.direct, req->sectors, usec);
+
+    bin = cdvdman_stats_log2(usec);
+    cdvdman_read_stats.latency[req->source][(bin < CDVDMAN_STATS_LAT_BINS) ? bin : (CDVDMAN_STATS_LAT_BINS - 1)]++;
+    CpuResumeIntr(OldState);
+}
+
+//-------------------------------------------------------------------------
+static void cdvdman_read_ahead(u32 lsn)
+{
+    unsigned int sectors = cdvdman_settings.ra_sectors;
+    unsigned int chunk;
+
+    // Do nothing if at least half of the cache is still ahead of us
+    if ((ra_count > 0) && (lsn >= ra_lsn) && ((lsn + sectors / 2) <= (ra_lsn + ra_count)))
+        return;
+
+    if (mediaLsnCount) {
+        if (lsn >= mediaLsnCount)
+            return;
+        if ((lsn + sectors) > mediaLsnCount)
+            sectors = mediaLsnCount - lsn;
+    }
+
+    M_DEBUG("    %s lsn=%lu sectors=%u\n", __FUNCTION__, lsn, sectors);
+
+    // Keep the cached sectors from lsn on, and only read the sectors following them
+    if ((ra_count > 0) && (lsn >= ra_lsn) && (lsn < (ra_lsn + ra_count))) {
+        ra_count = ra_lsn + ra_count - lsn;
+        memmove(ra_buf, &ra_buf[(lsn - ra_lsn) * 2048], ra_count * 2048);
+    } else
+        ra_count = 0;
+    ra_lsn = lsn;
+
+    // Fill the cache in small chunks, and stop as soon as a real request is queued
+    while ((ra_count < sectors) && (read_queue_count == 0)) {
+        chunk = sectors - ra_count;
+        if (chunk > CDVDMAN_RA_CHUNK)
+            chunk = CDVDMAN_RA_CHUNK;
+
+        if (DeviceReadSectors(lsn + ra_count, &ra_buf[ra_count * 2048], chunk) != SCECdErNO) {
+            ra_count = 0;
+            return;
+        }
+        ra_count += chunk;
+    }
 }
 
 //-------------------------------------------------------------------------
@@ -124,24 +294,39 @@ static void cdvdman_read_sectors(u32 lsn, unsigned int sectors, void *buf)
         }
     }
 
+    if (((cdvdman_settings.flags & CDVDMAN_COMPAT_FAST_READS) == 0) && (sectors > 0)) {
+        /*
+         * Start the emulated timing for the whole request.
+         * The device read of the next chunk runs while the timing window of the current chunk is running,
+         * so the device time is hidden under the emulated time instead of being added to it.
+         */
+        iop_sys_clock_t TargetTime;
+
+        USec2SysClock(usec_per_sector, &TargetTime);
+        read_timing.clock_per_sector = TargetTime.lo;
+        read_timing.pos_base = ReadPos;
+        read_timing.sectors = sectors;
+        read_timing.window = (sectors > 8) ? 8 : sectors;
+        read_timing.timed = 0;
+        read_timing.read = 0;
+
+        TargetTime.lo = read_timing.clock_per_sector * read_timing.window;
+        TargetTime.hi = 0;
+        ClearEventFlag(cdvdman_stat.intr_ef, ~(CDVDEF_READ_END | CDVDEF_READ_TIMED));
+        SetAlarm(&TargetTime, &cdvdman_read_sectors_end_cb, NULL);
+    }
+
     cdvdman_stat.err = SCECdErNO;
     for (ptr = buf, remaining = sectors; remaining > 0;) {
         unsigned int SectorsToRead = remaining;
 
-        if ((cdvdman_settings.flags & CDVDMAN_COMPAT_FAST_READS) == 0) {
-            // Limit transfers to a maximum length of 8, with a restricted transfer rate.
-            iop_sys_clock_t TargetTime;
-
-            if (SectorsToRead > 8)
-                SectorsToRead = 8;
-
-            USec2SysClock(usec_per_sector * SectorsToRead, &TargetTime);
-            ClearEventFlag(cdvdman_stat.intr_ef, ~CDVDEF_READ_END);
-            SetAlarm(&TargetTime, &cdvdman_read_sectors_end_cb, NULL);
-        }
+        if (((cdvdman_settings.flags & CDVDMAN_COMPAT_FAST_READS) == 0) && (SectorsToRead > 8))
+            SectorsToRead = 8;
 
-        cdvdman_stat.err = DeviceReadSectors(lsn, ptr, SectorsToRead);
+        cdvdman_stat.err = cdvdman_read_device(lsn, ptr, SectorsToRead);
+        cdvdman_read_stats.device_reads++;
         if (cdvdman_stat.err != SCECdErNO) {
+            cdvdman_read_stats.device_errors++;
             if ((cdvdman_settings.flags & CDVDMAN_COMPAT_FAST_READS) == 0)
                 CancelAlarm(&cdvdman_read_sectors_end_cb, NULL);
             break;
@@ -169,14 +354,34 @@ static void cdvdman_read_sectors(u32 lsn, unsigned int sectors, void *buf)
         ptr = (void *)((u8 *)ptr + (SectorsToRead * 2048));
         remaining -= SectorsToRead;
         lsn += SectorsToRead;
-        ReadPos += SectorsToRead * 2048;
 
         if ((cdvdman_settings.flags & CDVDMAN_COMPAT_FAST_READS) == 0) {
-            // Sleep until the required amount of time has been spent.
-            WaitEventFlag(cdvdman_stat.intr_ef, CDVDEF_READ_END, WEF_AND, NULL);
+            int OldState;
+
+            CpuSuspendIntr(&OldState);
+            read_timing.read += SectorsToRead;
+            cdvdman_read_timing_update_pos();
+            CpuResumeIntr(OldState);
+            SetEventFlag(cdvdman_stat.intr_ef, CDVDEF_READ_POS);
+
+            // Stay at most one chunk ahead: wait for the window of the previous chunk to pass
+            while ((remaining > 0) && ((read_timing.timed + 8) < read_timing.read)) {
+                ClearEventFlag(cdvdman_stat.intr_ef, ~CDVDEF_READ_TIMED);
+                if ((read_timing.timed + 8) >= read_timing.read)
+                    break;
+                WaitEventFlag(cdvdman_stat.intr_ef, CDVDEF_READ_TIMED, WEF_AND, NULL);
+            }
+        } else {
+            ReadPos += SectorsToRead * 2048;
+            SetEventFlag(cdvdman_stat.intr_ef, CDVDEF_READ_POS);
         }
     }
 
+    if (((cdvdman_settings.flags & CDVDMAN_COMPAT_FAST_READS) == 0) && (sectors > 0) && (cdvdman_stat.err == SCECdErNO)) {
+        // Sleep until the required amount of time has been spent.
+        WaitEventFlag(cdvdman_stat.intr_ef, CDVDEF_READ_END, WEF_AND, NULL);
+    }
+
     // If we had a read that went past the end of media, after reading what we can, set the end of media error.
     if (endOfMedia) {
         cdvdman_stat.err = SCECdErEOM;
@@ -184,51 +389,62 @@ static void cdvdman_read_sectors(u32 lsn, unsigned int sectors, void *buf)
 }
 
 //-------------------------------------------------------------------------
-// Same as cdvdman_read_sectors, but uses a bounce buffer for alignment
+// Same as cdvdman_read_sectors, but for unaligned buffers and sector sizes other than 2048
 static void cdvdman_read_sectors_bounce(u32 lsn, u32 sectors, u16 sector_size, void *buf)
 {
     // OPL only has 2048 bytes no matter what. For other sizes we have to copy to the offset and prepoluate the sector header data (the extra bytes.)
     u32 offset = 0;
+    u32 align;
+    u8 *aligned;
+    int i;
 
     if (sector_size == 2340)
         offset = 12; // head - sub - data(2048) -- edc-ecc
 
-    buf = (void *)PHYSADDR(buf);
-
-    // For transfers to unaligned buffers, a double-copy is required to avoid stalling the device's DMA channel.
-    WaitSema(cdvdman_searchfilesema);
+    if (sectors == 0)
+        return;
 
-    u32 nsectors, nbytes;
-    u32 rpos = lsn;
-
-    while (sectors > 0) {
-        nsectors = sectors;
-        if (nsectors > CDVDMAN_BUF_SECTORS)
-            nsectors = CDVDMAN_BUF_SECTORS;
+    buf = (void *)PHYSADDR(buf);
 
-        // For other sizes we can only read one sector at a time.
-        // There are only very few games (CDDA games, EA Tiburon) that will be affected
-        if (sector_size != 2048)
-            nsectors = 1;
+    // The device's DMA channel needs a 4-byte aligned buffer.
+    // Instead of bouncing every sector, read as much as possible into the aligned part of the callers buffer.
+    align = (4 - ((u32)buf & 3)) & 3;
+    aligned = (u8 *)buf + align;
+
+    if (sector_size == 2048) {
+        // The last sector does not fit after aligning, it is read using the bounce buffer
+        if (sectors > 1) {
+            cdvdman_read_sectors(lsn, sectors - 1, aligned);
+            if (cdvdman_stat.err != SCECdErNO)
+                return;
+            memmove(buf, aligned, (sectors - 1) * 2048);
+        }
 
-        cdvdman_read_sectors(rpos, nsectors, cdvdman_buf);
+        cdvdman_read_sectors(lsn + sectors - 1, 1, cdvdman_bounce_buf);
+        if (cdvdman_stat.err != SCECdErNO)
+            return;
+        memcpy((u8 *)buf + (sectors - 1) * 2048, cdvdman_bounce_buf, 2048);
+        return;
+    }
 
-        rpos += nsectors;
-        sectors -= nsectors;
-        nbytes = nsectors * sector_size;
+    // For the larger sector sizes all data fits: read everything at once
+    cdvdman_read_sectors(lsn, sectors, aligned);
+    if (cdvdman_stat.err != SCECdErNO)
+        return;
 
+    // Then expand the sectors in place. Going back to front, no sector overwrites data that has not been moved yet.
+    for (i = sectors - 1; i >= 0; i--) {
+        u8 *sector = (u8 *)buf + i * sector_size;
 
-        // Copy the data for buffer.
-        // For any sector other than 2048 one sector at a time is copied.
-        memcpy((void *)((u32)buf + offset), cdvdman_buf, nbytes);
+        memmove(sector + offset, aligned + i * 2048, 2048);
 
         // For these custom sizes we need to manually fix the header.
         // For 2340 we have 12bytes. 4 are position.
         if (sector_size == 2340) {
-            u8 *header = (u8 *)buf;
+            u8 *header = sector;
             // position.
             sceCdlLOCCD p;
-            sceCdIntToPos(rpos - 1, &p); // to get current pos.
+            sceCdIntToPos(lsn + i, &p);
             header[0] = p.minute;
             header[1] = p.second;
             header[2] = p.sector;
@@ -240,36 +456,66 @@ static void cdvdman_read_sectors_bounce(u32 lsn, u32 sectors, u16 sector_size, v
             header[6] = header[10] = 0x8;
             header[7] = header[11] = 0;
         }
-
-        buf = (void *)((u8 *)buf + nbytes);
     }
-
-    SignalSema(cdvdman_searchfilesema);
 }
 
 //--------------------------------------------------------------
 static void cdvdman_read_thread(void *args)
 {
     cdvdman_read_t req;
+    StmCallback_t callback;
+    int OldState, queue_empty, sequential, bounce;
+    u32 start, done_bit;
 
     while (1) {
         WaitSema(cdrom_rthread_sema);
-        memcpy(&req, &cdvdman_stat.req, sizeof(req));
+
+        // A deferred call takes the wake-up it was signalled with
+        if (DeferredCallback != NULL) {
+            CpuSuspendIntr(&OldState);
+            callback = DeferredCallback;
+            DeferredCallback = NULL;
+            CpuResumeIntr(OldState);
+
+            callback();
+            continue;
+        }
+
+        // The head entry is not released until the request has completed, so it can be copied without locking
+        memcpy(&req, &read_queue[read_queue_head], sizeof(req));
 
         M_DEBUG("  %s() [%d, %d, %d, %08x, %d]\n", __FUNCTION__, (int)req.lba, (int)req.sectors, (int)req.sector_size, (int)req.buf, (int)req.source);
 
         cdvdman_stat.status = SCECdStatRead;
-        if (((u32)(req.buf)&3) || (req.sector_size != 2048))
+        start = GetSystemTimeLow();
+        bounce = ((u32)(req.buf)&3) || (req.sector_size != 2048);
+        if (bounce)
             cdvdman_read_sectors_bounce(req.lba, req.sectors, req.sector_size, req.buf);
         else
             cdvdman_read_sectors(req.lba, req.sectors, req.buf);
         ReadPos = 0; /* Reset the buffer offset indicator. */
-        cdvdman_stat.status = SCECdStatPause;
+        cdvdman_stats_request(&req, bounce, GetSystemTimeLow() - start);
 
         M_DEBUG("  %s() read done, unlock and callback...\n", __FUNCTION__);
 
-        sync_flag_locked = 0;
-        SetEventFlag(cdvdman_stat.intr_ef, CDVDEF_MAN_UNLOCKED);
+        // Release the request, only unlock when no other requests are pending
+        CpuSuspendIntr(&OldState);
+        read_queue[read_queue_head].err = cdvdman_stat.err;
+        done_bit = 1 << read_queue_head;
+        read_queue_head = (read_queue_head + 1) % CDVDMAN_READ_QUEUE_SIZE;
+        read_queue_count--;
+        read_queue_completed++;
+        if (req.source != ECS_STREAMING)
+            cdvdman_read_others_pending--;
+        queue_empty = (read_queue_count == 0);
+        if (queue_empty) {
+            cdvdman_stat.status = SCECdStatPause;
+            sync_flag_locked = 0;
+        }
+        CpuResumeIntr(OldState);
+
+        SetEventFlag(read_queue_ef, done_bit);
+        SetEventFlag(cdvdman_stat.intr_ef, queue_empty ? (CDVDEF_READ_POS | CDVDEF_MAN_UNLOCKED) : CDVDEF_READ_POS);
 
         switch (req.source) {
             case ECS_EXTERNAL:
@@ -298,12 +544,24 @@ static void cdvdman_read_thread(void *args)
                 break;
         }
 
+        // Fetch the next sectors of a sequential run, but never delay pending requests
+        sequential = (req.lba == ra_next_lsn);
+        ra_next_lsn = req.lba + req.sectors;
+        if ((ra_buf != NULL) && sequential && (read_queue_count == 0))
+            cdvdman_read_ahead(ra_next_lsn);
+
         M_DEBUG("  %s() done\n", __FUNCTION__);
     }
 }
 
 //-------------------------------------------------------------------------
-int sceCdRead_internal(u32 lsn, u32 sectors, void *buf, sceCdRMode *mode, enum ECallSource source)
+static int cdvdman_read_is_queue_thread(int intct)
+{
+    return !intct && (read_queue_thid != 0) && (GetThreadId() == read_queue_thid);
+}
+
+//-------------------------------------------------------------------------
+int cdvdman_read_submit(u32 lsn, u32 sectors, void *buf, sceCdRMode *mode, enum ECallSource source, u32 *ticket)
 {
 #ifdef DEBUG
     static u32 free_prev = 0;
@@ -311,8 +569,11 @@ int sceCdRead_internal(u32 lsn, u32 sectors, void *buf, sceCdRMode *mode, enum E
 #endif
     int OldState;
     u16 sector_size = 2048;
+    unsigned int slot;
+    cdvdman_read_t *req;
 
     int intct = QueryIntrContext();
+    int may_queue = (source != ECS_EXTERNAL) || cdvdman_read_is_queue_thread(intct);
 
 #ifdef DEBUG
     if (mode != NULL)
@@ -344,24 +605,44 @@ int sceCdRead_internal(u32 lsn, u32 sectors, void *buf, sceCdRMode *mode, enum E
     //
     CpuSuspendIntr(&OldState);
     {
-        if (sync_flag_locked) {
+        // Games expect sceCdRead to fail while the drive is busy, only internal and CDVDFSV requests are queued
+        if (!may_queue && sync_flag_locked) {
+            cdvdman_read_stats.locked_rejects++;
             CpuResumeIntr(OldState);
             M_DEBUG("%s: exiting (sync_flag_locked)...\n", __FUNCTION__);
             return 0;
         }
 
-        if (intct)
+        if (read_queue_count >= CDVDMAN_READ_QUEUE_SIZE) {
+            cdvdman_read_stats.queue_full++;
+            CpuResumeIntr(OldState);
+            M_DEBUG("%s: exiting (queue full)...\n", __FUNCTION__);
+            return 0;
+        }
+
+        slot = (read_queue_head + read_queue_count) % CDVDMAN_READ_QUEUE_SIZE;
+        if (intct) {
             iClearEventFlag(cdvdman_stat.intr_ef, ~CDVDEF_MAN_UNLOCKED);
-        else
+            iClearEventFlag(read_queue_ef, ~(1 << slot));
+        } else {
             ClearEventFlag(cdvdman_stat.intr_ef, ~CDVDEF_MAN_UNLOCKED);
+            ClearEventFlag(read_queue_ef, ~(1 << slot));
+        }
 
         sync_flag_locked = 1;
 
-        cdvdman_stat.req.lba = lsn;
-        cdvdman_stat.req.sectors = sectors;
-        cdvdman_stat.req.sector_size = sector_size;
-        cdvdman_stat.req.buf = buf;
-        cdvdman_stat.req.source = source;
+        req = &read_queue[slot];
+        req->lba = lsn;
+        req->sectors = sectors;
+        req->sector_size = sector_size;
+        req->buf = buf;
+        req->source = source;
+        read_queue_count++;
+        read_queue_submitted++;
+        if (source != ECS_STREAMING)
+            cdvdman_read_others_pending++;
+        if (ticket != NULL)
+            *ticket = read_queue_submitted;
     }
     CpuResumeIntr(OldState);
 
@@ -378,14 +659,62 @@ int sceCdRead_internal(u32 lsn, u32 sectors, void *buf, sceCdRMode *mode, enum E
     return 1;
 }
 
+//-------------------------------------------------------------------------
+int sceCdRead_internal(u32 lsn, u32 sectors, void *buf, sceCdRMode *mode, enum ECallSource source)
+{
+    int result;
+
+    // The queue thread waits for the oldest request to free its entry, instead of failing when the queue is full
+    while (((result = cdvdman_read_submit(lsn, sectors, buf, mode, source, NULL)) == 0) && cdvdman_read_is_queue_thread(QueryIntrContext()))
+        WaitEventFlag(read_queue_ef, 1 << read_queue_head, WEF_AND, NULL);
+
+    return result;
+}
+
+//-------------------------------------------------------------------------
+int cdvdman_read_wait(u32 ticket)
+{
+    // Tickets and queue entries are assigned in the same order, starting at ticket 1 in entry 0.
+    // The bit is only cleared again when the entry is reused, and that request will set it again.
+    unsigned int slot = (ticket - 1) % CDVDMAN_READ_QUEUE_SIZE;
+
+    // Tickets complete in order, the subtraction handles wrap-around
+    while ((s32)(read_queue_completed - ticket) < 0)
+        WaitEventFlag(read_queue_ef, 1 << slot, WEF_AND, NULL);
+
+    // The result stays valid until the entry is reused and completes again
+    return read_queue[slot].err;
+}
+
+//-------------------------------------------------------------------------
+int cdvdman_read_sync(u32 lsn, u32 sectors, void *buf, enum ECallSource source)
+{
+    u32 ticket;
+
+    // Wait for the oldest request to free its entry instead of polling
+    while (cdvdman_read_submit(lsn, sectors, buf, NULL, source, &ticket) == 0)
+        WaitEventFlag(read_queue_ef, 1 << read_queue_head, WEF_AND, NULL);
+
+    // Only wait for our own request, not for requests queued after it
+    return (cdvdman_read_wait(ticket) == SCECdErNO) ? 1 : 0;
+}
+
 //-------------------------------------------------------------------------
 void cdvdman_read_init()
 {
     iop_thread_t thread_param;
+    iop_event_t event;
     iop_sema_t smp;
 
+    // All queue entries start free
+    event.attr = EA_MULTI;
+    event.option = 0;
+    event.bits = (1 << CDVDMAN_READ_QUEUE_SIZE) - 1;
+    read_queue_ef = CreateEventFlag(&event);
+
+    // Signalled once for every queued request, and once for the deferred call
     smp.initial = 0;
-    smp.max = 1;
+    smp.max = CDVDMAN_READ_QUEUE_SIZE + 1;
     smp.attr = 0;
     smp.option = 0;
     cdrom_rthread_sema = CreateSema(&smp);
@@ -393,6 +722,12 @@ void cdvdman_read_init()
     cdvdman_stat.status = SCECdStatPause;
     cdvdman_stat.err = SCECdErNO;
 
+    // Limit max sectors
+    if (cdvdman_settings.ra_sectors > 128)
+        cdvdman_settings.ra_sectors = 128;
+    if (cdvdman_settings.ra_sectors > 0)
+        ra_buf = AllocSysMemory(0, cdvdman_settings.ra_sectors * 2048, NULL);
+
     thread_param.thread = &cdvdman_read_thread;
     thread_param.stacksize = 0x1000;
     thread_param.priority = 8;
@@ -408,6 +743,42 @@ void cdvdman_read_set_stm0_callback(StmCallback_t callback)
     Stm0Callback = callback;
 }
 
+//-------------------------------------------------------------------------
+void cdvdman_read_set_queue_thread(int thid)
+{
+    read_queue_thid = thid;
+}
+
+//-------------------------------------------------------------------------
+void cdvdman_read_defer(StmCallback_t callback)
+{
+    // Only one call can be pending, the semaphore is signalled once for it
+    if (DeferredCallback == NULL) {
+        DeferredCallback = callback;
+        iSignalSema(cdrom_rthread_sema);
+    }
+}
+
+//-------------------------------------------------------------------------
+void cdvdman_read_get_stats(struct cdvdman_read_stats *stats)
+{
+    int OldState;
+
+    CpuSuspendIntr(&OldState);
+    memcpy(stats, &cdvdman_read_stats, sizeof(cdvdman_read_stats));
+    CpuResumeIntr(OldState);
+}
+
+//-------------------------------------------------------------------------
+void cdvdman_read_reset_stats(void)
+{
+    int OldState;
+
+    CpuSuspendIntr(&OldState);
+    memset(&cdvdman_read_stats, 0, sizeof(cdvdman_read_stats));
+    CpuResumeIntr(OldState);
+}
+
 //-------------------------------------------------------------------------
 // Exported API function
 u32 sceCdGetReadPos(void)
@@ -9,12 +9,30 @@ typedef void (*StmCallback_t)(void);
 
 
 extern volatile unsigned char sync_flag_locked;
+extern volatile unsigned int cdvdman_read_others_pending;
+extern struct cdvdman_read_stats cdvdman_read_stats;
 
 
 void cdvdman_read_init();
 
 int sceCdRead_internal(u32 lsn, u32 sectors, void *buf, sceCdRMode *mode, enum ECallSource source);
+// Queue a read request, returns 0 when the queue is full or, for ECS_EXTERNAL, when a read is in progress.
+// ECS_EXTERNAL requests from the queue thread are queued while a read is in progress.
+// The ticket can be used to wait for completion.
+int cdvdman_read_submit(u32 lsn, u32 sectors, void *buf, sceCdRMode *mode, enum ECallSource source, u32 *ticket);
+// Wait for a queued read request to complete, returns the SCECdEr* result of the request
+int cdvdman_read_wait(u32 ticket);
+// Queue a read request and wait for it to complete (thread context only), returns 0 when the read failed
+int cdvdman_read_sync(u32 lsn, u32 sectors, void *buf, enum ECallSource source);
 void cdvdman_read_set_stm0_callback(StmCallback_t callback);
+// Set the thread whose sceCdRead calls are queued instead of failing while busy, 0 for none
+void cdvdman_read_set_queue_thread(int thid);
+// Run a callback on the read thread, before the next queued request (interrupt context only).
+// Only one call can be pending, so this is only used for a single callback.
+void cdvdman_read_defer(StmCallback_t callback);
+// Copy or clear the read statistics (thread context only)
+void cdvdman_read_get_stats(struct cdvdman_read_stats *stats);
+void cdvdman_read_reset_stats(void);
 
 
 #endif
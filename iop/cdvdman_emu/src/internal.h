@@ -32,6 +32,9 @@
 #define CDVDEF_POWER_OFF     0x0002
 #define CDVDEF_FSV_S596      0x0004
 #define CDVDEF_STM_DONE      0x0008 // Streaming read done
+#define CDVDEF_READ_TIMED    0x0010 // Accurate reads timing window passed
+// 0x0020 is CDVDEF_READ_POS, shared with other modules in cdvdman_opl.h
+#define CDVDEF_STM_DMA       0x0040 // Streaming transfer to EE RAM done
 #define CDVDEF_READ_END      0x1000 // Accurate reads timing event
 #define CDVDEF_CB_DONE       0x2000
 
@@ -44,9 +47,13 @@ struct SteamingData
     unsigned short int StReadPtr;
     unsigned short int StStreamed;
     unsigned short int StStat;
-    unsigned short int StIsReading;
+    unsigned short int StIsReading; // A thread is queuing banks, only one at a time
+    unsigned short int StFillPtr;   // Start of the next bank to queue
+    unsigned short int StPending;   // Sectors queued to the read thread but not read yet
+    u32 StBankBusy;                 // Bitmap of the banks queued to the read thread
+    unsigned short int StDmaPending; // Sectors being transferred to EE RAM, still owned by the ring buffer
     void *StIOP_bufaddr;
-    u32 Stlsn;
+    u32 Stlsn; // Sector of the next bank to queue
 };
 
 enum ECallSource {
@@ -63,6 +70,7 @@ typedef struct
     u16 sector_size;
     void *buf;
     enum ECallSource source;
+    int err; // Result of the request, valid once it has completed
 } cdvdman_read_t;
 
 typedef struct
@@ -72,7 +80,6 @@ typedef struct
     struct SteamingData StreamingData;
     int intr_ef;
     int disc_type_reg; // SCECdvdMediaType
-    cdvdman_read_t req; // Next requested read
 } cdvdman_status_t;
 
 struct dirTocEntry
@@ -104,11 +111,13 @@ extern void cdvdman_cb_event(int reason);
 extern void cdvdman_init(void);
 extern void cdvdman_fs_init(void);
 extern void cdvdman_searchfile_init(void);
+extern u8 *cdvdman_window_sector(u32 lsn, unsigned int size, unsigned int sector, unsigned int max, enum ECallSource source);
+extern void cdvdman_window_invalidate(void);
 extern void cdvdman_initdev(void);
 
 extern struct cdvdman_settings_common cdvdman_settings;
 
-// Normally this buffer is only used by 'searchfile', only 1 sector used
+// Normally these buffers are only 1 sector: cdvdman_buf for 'searchfile' and the bounce buffer of the read thread
 #define CDVDMAN_BUF_SECTORS 1
 extern u8 cdvdman_buf[CDVDMAN_BUF_SECTORS * 2048];
 #define CDVDMAN_FS_BUF_ALIGNMENT 64
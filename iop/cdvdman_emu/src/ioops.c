@@ -13,6 +13,8 @@ typedef struct
     u32 lsn;
     unsigned int filesize;
     unsigned int position;
+    unsigned int read_end; // File position where the last read ended
+    unsigned int window;   // Number of sectors to fill the sector window with
 } FHANDLE;
 
 #define MAX_FDHANDLES 64
@@ -134,6 +136,8 @@ static int cdvdman_open(iop_file_t *f, const char *filename, int mode)
                 fh->filesize = cdfile.size;
                 fh->lsn = cdfile.lsn;
                 fh->position = 0;
+                fh->read_end = 0;
+                fh->window = 1;
                 r = 0;
 
                 M_DEBUG("open ret=%d lsn=%d size=%d\n", r, (int)fh->lsn, (int)fh->filesize);
@@ -266,6 +270,7 @@ static int cdrom_read(iop_file_t *f, void *buf, int size)
 {
     FHANDLE *fh = (FHANDLE *)f->privdata;
     unsigned int offset, nsectors, nbytes;
+    u8 *sector;
     int rpos;
 
     WaitSema(cdrom_io_sema);
@@ -277,52 +282,51 @@ static int cdrom_read(iop_file_t *f, void *buf, int size)
 
     sceCdDiskReady(0);
 
+    // Grow the window on sequential reads, so small reads of a streamed file are batched.
+    // Random access reads only the sector it needs.
+    if (fh->position == fh->read_end) {
+        if (fh->window < cdvdman_settings.fs_sectors)
+            fh->window *= 2;
+        if (fh->window > cdvdman_settings.fs_sectors)
+            fh->window = cdvdman_settings.fs_sectors;
+    } else
+        fh->window = 1;
+
     rpos = 0;
-    if (size > 0) {
-        // Phase 1: read data until the offset of the file is nicely aligned to a 2048-byte boundary.
-        if ((offset = fh->position % 2048) != 0) {
+    while (size > 0) {
+        offset = fh->position % 2048;
+
+        if (offset == 0 && (nsectors = size / 2048) > 0) {
+            // Read whole sectors directly into the buffer
+            nbytes = nsectors * 2048;
+            if (cdvdman_read_sync(fh->lsn + (fh->position / 2048), nsectors, buf, ECS_EE_RPC) == 0)
+                break;
+        } else {
+            // Partial sector: serve it from the sector window, so small sequential reads read each sector once
             nbytes = 2048 - offset;
             if (size < nbytes)
                 nbytes = size;
-            while (sceCdRead_internal(fh->lsn + (fh->position / 2048), 1, cdvdman_fs_buf, NULL, ECS_EE_RPC) == 0)
-                DelayThread(10000);
-
-            fh->position += nbytes;
-            size -= nbytes;
-            rpos += nbytes;
-
-            sceCdSync(0);
-            memcpy(buf, &cdvdman_fs_buf[offset], nbytes);
-            buf = (void *)((u8 *)buf + nbytes);
-        }
-
-        // Phase 2: read the data to the middle of the buffer, in units of 2048.
-        if ((nsectors = size / 2048) > 0) {
-            nbytes = nsectors * 2048;
-
-            while (sceCdRead_internal(fh->lsn + (fh->position / 2048), nsectors, buf, NULL, ECS_EE_RPC) == 0)
-                DelayThread(10000);
 
-            buf += nbytes;
-            size -= nbytes;
-            fh->position += nbytes;
-            rpos += nbytes;
+            WaitSema(cdvdman_searchfilesema);
+            sector = cdvdman_window_sector(fh->lsn, fh->filesize, fh->position / 2048, fh->window, ECS_EE_RPC);
+            if (sector != NULL)
+                memcpy(buf, &sector[offset], nbytes);
+            SignalSema(cdvdman_searchfilesema);
 
-            sceCdSync(0);
+            if (sector == NULL)
+                break;
         }
 
-        // Phase 3: read any remaining data that isn't divisible by 2048.
-        if ((nbytes = size) > 0) {
-            while (sceCdRead_internal(fh->lsn + (fh->position / 2048), 1, cdvdman_fs_buf, NULL, ECS_EE_RPC) == 0)
-                DelayThread(10000);
-
-            fh->position += nbytes;
-            rpos += nbytes;
-
-            sceCdSync(0);
-            memcpy(buf, cdvdman_fs_buf, nbytes);
-        }
+        buf = (void *)((u8 *)buf + nbytes);
+        size -= nbytes;
+        fh->position += nbytes;
+        rpos += nbytes;
     }
+    fh->read_end = fh->position;
+
+    // Report the data read before a failure, or the failure itself
+    if ((size > 0) && (rpos == 0))
+        rpos = -EIO;
 
     //M_DEBUG("cdrom_read ret=%d\n", rpos);
     SignalSema(cdrom_io_sema);
@@ -390,6 +394,7 @@ static int cdrom_dread(iop_file_t *f, iox_dirent_t *dirent)
 {
     int r = 0;
     u32 mode;
+    u8 *dir;
     FHANDLE *fh = (FHANDLE *)f->privdata;
     struct dirTocEntry *tocEntryPointer;
 
@@ -398,19 +403,32 @@ static int cdrom_dread(iop_file_t *f, iox_dirent_t *dirent)
     M_DEBUG("%s fh->lsn=%lu\n", __FUNCTION__, fh->lsn);
 
     sceCdDiskReady(0);
-    if ((r = sceCdRead_internal(fh->lsn, 1, cdvdman_fs_buf, NULL, ECS_EE_RPC)) == 1) {
-        sceCdSync(0);
 
-        do {
-            r = 0;
-            tocEntryPointer = (struct dirTocEntry *)&cdvdman_fs_buf[fh->position];
-            if (tocEntryPointer->length == 0)
-                break;
+    // The directory extent is parsed from the directory buffer, shared with the path lookups
+    WaitSema(cdvdman_searchfilesema);
+
+    r = 0;
+    while (fh->position < fh->filesize) {
+        if ((dir = cdvdman_window_sector(fh->lsn, fh->filesize, fh->position / 2048, cdvdman_settings.fs_sectors, ECS_EE_RPC)) == NULL)
+            break;
+
+        // Entries do not cross sector boundaries, the rest of the sector is padding
+        tocEntryPointer = (struct dirTocEntry *)&dir[fh->position % 2048];
+        if (((fh->position % 2048) >= 2016) || (tocEntryPointer->length == 0)) {
+            fh->position = (fh->position / 2048 + 1) * 2048;
+            continue;
+        }
 
-            fh->position += tocEntryPointer->length;
+        fh->position += tocEntryPointer->length;
+
+        // Skip the '.' and '..' entries
+        if (tocEntryPointer->filenameLength != 1) {
             r = 1;
-        } while (tocEntryPointer->filenameLength == 1);
+            break;
+        }
+    }
 
+    if (r == 1) {
         mode = 0x2124;
         if (tocEntryPointer->fileProperties & 2)
             mode = 0x116d;
@@ -424,6 +442,7 @@ static int cdrom_dread(iop_file_t *f, iox_dirent_t *dirent)
     } else
         M_DEBUG("%s r=%d\n", __FUNCTION__, r);
 
+    SignalSema(cdvdman_searchfilesema);
     SignalSema(cdrom_io_sema);
 
     return r;
@@ -540,6 +559,17 @@ static int cdrom_devctl(iop_file_t *f, const char *name, int cmd, void *args, u3
             *(int *)buf = cdvdman_stat.intr_ef;
             result = cdvdman_stat.intr_ef;
             break;
+        case CDIOC_GETREADSTATS:
+            if (buflen < sizeof(struct cdvdman_read_stats)) {
+                result = -EINVAL;
+                break;
+            }
+            cdvdman_read_get_stats((struct cdvdman_read_stats *)buf);
+            result = sizeof(struct cdvdman_read_stats);
+            break;
+        case CDIOC_RESETREADSTATS:
+            cdvdman_read_reset_stats();
+            break;
         default:
             M_DEBUG("%s unknown, cmd=0x%X\n", __FUNCTION__, cmd);
             result = -EIO;
@@ -194,8 +194,10 @@ int sceCdGetToc_internal(u8 *toc, enum ECallSource source)
 {
     M_DEBUG("%s(-)\n", __FUNCTION__);
 
-    if (sync_flag_locked)
+    if (sync_flag_locked) {
+        cdvdman_read_stats.locked_rejects++;
         return 0;
+    }
 
     cdvdman_stat.err = SCECdErNO;
     int result = cdvdman_fill_toc(toc);
@@ -220,8 +222,10 @@ int sceCdSeek_internal(u32 lsn, enum ECallSource source)
 {
     M_DEBUG("%s(%d)\n", __FUNCTION__, (int)lsn);
 
-    if (sync_flag_locked)
+    if (sync_flag_locked) {
+        cdvdman_read_stats.locked_rejects++;
         return 0;
+    }
 
     cdvdman_stat.err = SCECdErNO;
 
@@ -270,8 +274,10 @@ int sceCdStop_internal(enum ECallSource source)
 {
     M_DEBUG("%s()\n", __FUNCTION__);
 
-    if (sync_flag_locked)
+    if (sync_flag_locked) {
+        cdvdman_read_stats.locked_rejects++;
         return 0;
+    }
 
     cdvdman_stat.err = SCECdErNO;
 
@@ -293,8 +299,10 @@ int sceCdPause_internal(enum ECallSource source)
 {
     M_DEBUG("%s()\n", __FUNCTION__);
 
-    if (sync_flag_locked)
+    if (sync_flag_locked) {
+        cdvdman_read_stats.locked_rejects++;
         return 0;
+    }
 
     cdvdman_stat.err = SCECdErNO;
 
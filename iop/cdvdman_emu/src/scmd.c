@@ -130,8 +130,10 @@ int sceCdBreak_internal(enum ECallSource source)
 {
     M_DEBUG("%s() locked = %d\n", __FUNCTION__, sync_flag_locked);
 
-    if (sync_flag_locked)
+    if (sync_flag_locked) {
+        cdvdman_read_stats.locked_rejects++;
         return 0;
+    }
 
     cdvdman_stat.status = SCECdStatPause;
 
@@ -22,6 +22,181 @@ typedef struct
 
 static layer_info_t layer_info[2];
 
+// Hash of a path: FNV-1a, and an independent djb2 hash of the same path to verify a match.
+// Case sensitive like the directory record compare, '/' and '\\' are the same.
+typedef struct
+{
+    u32 hash; // 0 = unused
+    u32 check;
+} path_hash_t;
+
+// Path lookup cache, maps the hash of a full path to the location of the file or directory.
+// Direct mapped: a new entry simply replaces the entry that is in its slot.
+#define PATHCACHE_SIZE 64 // Must be a power of 2
+#define PATHCACHE_DIR  0x01
+
+typedef struct
+{
+    path_hash_t key;
+    u32 lsn;
+    u32 size;
+    u32 flags;
+} pathcache_entry_t;
+
+static pathcache_entry_t pathcache[PATHCACHE_SIZE];
+
+// Directory index, built from the image at startup and sorted by hash.
+// Only directories are indexed, so a file is found by reading only the directory it is in.
+// Directories that don't fit are looked up from the root, like without the index.
+#define DIRINDEX_MAX 1024
+
+typedef struct
+{
+    path_hash_t key;
+    u32 lsn;
+    u32 size;
+} dirindex_entry_t;
+
+static dirindex_entry_t *dirindex = NULL;
+static unsigned int dirindex_count = 0;
+
+// Sector window, holds sectors of one directory or file extent.
+// Shared by the path lookups, cdrom_dread and the partial sector reads of cdrom_read,
+// protected by cdvdman_searchfilesema. The window is the FSV buffer: CDVDFSV locks
+// cdvdman_searchfilesema too while it uses the buffer, and empties the window.
+static u8 *window_buf = cdvdman_buf;
+static unsigned int window_sectors = CDVDMAN_BUF_SECTORS;
+static u32 window_lsn;
+static unsigned int window_count = 0;
+
+//-------------------------------------------------------------------------
+// Return a sector of an extent. When it is not buffered, read up to max sectors
+// of the extent into the sector window, starting at this sector.
+// Returns NULL when the read failed, the window is then empty.
+u8 *cdvdman_window_sector(u32 lsn, unsigned int size, unsigned int sector, unsigned int max, enum ECallSource source)
+{
+    unsigned int count;
+
+    lsn += sector;
+    if (lsn >= window_lsn && lsn < (window_lsn + window_count))
+        return &window_buf[(lsn - window_lsn) * 2048];
+
+    count = ((size + 2047) / 2048) - sector;
+    if (count > max)
+        count = max;
+    if (count > window_sectors)
+        count = window_sectors;
+    if (count < 1)
+        count = 1;
+
+    window_count = 0;
+    if (cdvdman_read_sync(lsn, count, window_buf, source) == 0)
+        return NULL;
+
+    window_lsn = lsn;
+    window_count = count;
+
+    return window_buf;
+}
+
+//-------------------------------------------------------------------------
+// Forget the contents of the sector window, the caller must hold cdvdman_searchfilesema
+void cdvdman_window_invalidate(void)
+{
+    window_count = 0;
+}
+
+//-------------------------------------------------------------------------
+static void cdvdman_path_hash_add(path_hash_t *key, const char *path, int len)
+{
+    int i;
+
+    for (i = 0; (i != len) && (path[i] != '\0'); i++) {
+        char c = (path[i] == '\\') ? '/' : path[i];
+
+        key->hash = (key->hash ^ (u8)c) * 16777619u;
+        key->check = (key->check * 33) ^ (u8)c;
+    }
+}
+
+//-------------------------------------------------------------------------
+static void cdvdman_path_hash_end(path_hash_t *key, int layer)
+{
+    // Layer 1 has its own directory tree
+    key->hash = (key->hash ^ (u8)layer) * 16777619u;
+    key->check = (key->check * 33) ^ (u8)layer;
+
+    // 0 marks an unused entry
+    if (key->hash == 0)
+        key->hash = 1;
+}
+
+//-------------------------------------------------------------------------
+// Hash of a full path, ignoring leading separators. len < 0 hashes the complete string.
+static void cdvdman_path_hash(path_hash_t *key, const char *path, int len, int layer)
+{
+    key->hash = 2166136261u;
+    key->check = 5381;
+
+    while ((len != 0) && ((*path == '/') || (*path == '\\'))) {
+        path++;
+        len--;
+    }
+
+    cdvdman_path_hash_add(key, path, len);
+    cdvdman_path_hash_end(key, layer);
+}
+
+//-------------------------------------------------------------------------
+static pathcache_entry_t *cdvdman_pathcache_lookup(const path_hash_t *key)
+{
+    pathcache_entry_t *entry = &pathcache[key->hash & (PATHCACHE_SIZE - 1)];
+
+    if ((entry->key.hash != key->hash) || (entry->key.check != key->check))
+        return NULL;
+
+    return entry;
+}
+
+//-------------------------------------------------------------------------
+static void cdvdman_pathcache_add(const path_hash_t *key, u32 lsn, u32 size, u32 flags)
+{
+    pathcache_entry_t *entry = &pathcache[key->hash & (PATHCACHE_SIZE - 1)];
+
+    entry->key = *key;
+    entry->lsn = lsn;
+    entry->size = size;
+    entry->flags = flags;
+}
+
+//-------------------------------------------------------------------------
+// Binary search in the directory index
+static dirindex_entry_t *cdvdman_dirindex_lookup(const path_hash_t *key)
+{
+    int lo = 0, hi = (int)dirindex_count - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+
+        if (dirindex[mid].key.hash == key->hash) {
+            // Go to the first entry with this hash, then compare the second hash of all of them
+            while ((mid > 0) && (dirindex[mid - 1].key.hash == key->hash))
+                mid--;
+            for (; (mid < (int)dirindex_count) && (dirindex[mid].key.hash == key->hash); mid++) {
+                if (dirindex[mid].key.check == key->check)
+                    return &dirindex[mid];
+            }
+            return NULL;
+        }
+        if (dirindex[mid].key.hash < key->hash)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return NULL;
+}
+
 //-------------------------------------------------------------------------
 static void cdvdman_trimspaces(char *str)
 {
@@ -53,6 +228,8 @@ static struct dirTocEntry *cdvdman_locatefile(char *name, u32 tocLBA, int tocLen
     char *slash;
     int r, len, filename_len;
     int tocPos;
+    unsigned int sector;
+    u8 *dir;
     struct dirTocEntry *tocEntryPointer;
 
 lbl_startlocate:
@@ -97,18 +274,14 @@ lbl_startlocate:
         strcpy(cdvdman_dirname, p);
     }
 
-    while (tocLength > 0) {
-        if (sceCdRead_internal(tocLBA, 1, cdvdman_buf, NULL, ECS_SEARCHFILE) == 0)
+    for (sector = 0; (sector * 2048) < tocLength; sector++) {
+        if ((dir = cdvdman_window_sector(tocLBA, tocLength, sector, window_sectors, ECS_SEARCHFILE)) == NULL)
             return NULL;
-        sceCdSync(0);
         //M_DEBUG("%s tocLBA read done\n", __FUNCTION__);
 
-        tocLength -= 2048;
-        tocLBA++;
-
         tocPos = 0;
         do {
-            tocEntryPointer = (struct dirTocEntry *)&cdvdman_buf[tocPos];
+            tocEntryPointer = (struct dirTocEntry *)&dir[tocPos];
 
             if (tocEntryPointer->length == 0)
                 break;
@@ -155,8 +328,13 @@ lbl_startlocate:
 static int cdvdman_findfile(sceCdlFILE *pcdfile, const char *name, int layer)
 {
     static char cdvdman_filepath[256];
-    u32 lsn;
+    u32 lsn, tocLBA;
+    int tocLength;
+    char *path, *slash;
     struct dirTocEntry *tocEntryPointer;
+    path_hash_t key, dir_key;
+    pathcache_entry_t *entry;
+    dirindex_entry_t *dir;
     layer_info_t *pLayerInfo;
 
     cdvdman_init();
@@ -180,20 +358,54 @@ static int cdvdman_findfile(sceCdlFILE *pcdfile, const char *name, int layer)
         return 0;
     }
 
-    tocEntryPointer = cdvdman_locatefile(cdvdman_filepath, pLayerInfo->rootDirtocLBA, pLayerInfo->rootDirtocLength, layer);
-    if (tocEntryPointer == NULL) {
-        SignalSema(cdvdman_searchfilesema);
-        return 0;
-    }
+    // Try the path cache first, no disc access needed
+    cdvdman_path_hash(&key, cdvdman_filepath, -1, layer);
+    entry = cdvdman_pathcache_lookup(&key);
+    if (entry != NULL) {
+        M_DEBUG("%s cache hit %s\n", __FUNCTION__, cdvdman_filepath);
+        pcdfile->lsn = entry->lsn;
+        pcdfile->size = entry->size;
+    } else {
+        // Start searching from the parent directory if it is cached or indexed, otherwise from the root
+        path = cdvdman_filepath;
+        tocLBA = pLayerInfo->rootDirtocLBA;
+        tocLength = pLayerInfo->rootDirtocLength;
+
+        slash = strrchr(path, '\\');
+        if ((slash == NULL) || (strrchr(path, '/') > slash))
+            slash = strrchr(path, '/');
+        if (slash != NULL) {
+            cdvdman_path_hash(&dir_key, path, slash - path, layer);
+            entry = cdvdman_pathcache_lookup(&dir_key);
+            if ((entry != NULL) && (entry->flags & PATHCACHE_DIR)) {
+                path = &slash[1];
+                tocLBA = entry->lsn;
+                tocLength = entry->size;
+            } else if ((dir = cdvdman_dirindex_lookup(&dir_key)) != NULL) {
+                M_DEBUG("%s index hit %s\n", __FUNCTION__, cdvdman_filepath);
+                path = &slash[1];
+                tocLBA = dir->lsn;
+                tocLength = dir->size;
+            }
+        }
 
-    lsn = tocEntryPointer->fileLBA;
-    if (layer) {
-        sceCdReadDvdDualInfo((int *)&pcdfile->lsn, (unsigned int *)&pcdfile->size);
-        lsn += pcdfile->size;
-    }
+        tocEntryPointer = cdvdman_locatefile(path, tocLBA, tocLength, layer);
+        if (tocEntryPointer == NULL) {
+            SignalSema(cdvdman_searchfilesema);
+            return 0;
+        }
+
+        lsn = tocEntryPointer->fileLBA;
+        if (layer) {
+            sceCdReadDvdDualInfo((int *)&pcdfile->lsn, (unsigned int *)&pcdfile->size);
+            lsn += pcdfile->size;
+        }
+
+        pcdfile->lsn = lsn;
+        pcdfile->size = tocEntryPointer->fileSize;
 
-    pcdfile->lsn = lsn;
-    pcdfile->size = tocEntryPointer->fileSize;
+        cdvdman_pathcache_add(&key, pcdfile->lsn, pcdfile->size, (tocEntryPointer->fileProperties & 2) ? PATHCACHE_DIR : 0);
+    }
 
     strcpy(pcdfile->name, strrchr(name, '\\') + 1);
 
@@ -220,12 +432,203 @@ int sceCdLayerSearchFile(sceCdlFILE *fp, const char *name, int layer)
     return cdvdman_findfile(fp, name, layer);
 }
 
+//-------------------------------------------------------------------------
+// Add all entries of the root directory to the path cache, including the first-level directories
+static void cdvdman_pathcache_fill_root(int layer)
+{
+    char name[32];
+    path_hash_t key;
+    u32 tocLBA, lsn;
+    int tocLength, tocPos, layer1_start = 0;
+    unsigned int sector;
+    u8 *dir;
+    struct dirTocEntry *tocEntryPointer;
+
+    tocLBA = layer_info[layer].rootDirtocLBA;
+    tocLength = layer_info[layer].rootDirtocLength;
+
+    if (layer) {
+        int on_dual;
+        sceCdReadDvdDualInfo(&on_dual, (unsigned int *)&layer1_start);
+    }
+
+    for (sector = 0; (sector * 2048) < tocLength; sector++) {
+        if ((dir = cdvdman_window_sector(tocLBA, tocLength, sector, window_sectors, ECS_SEARCHFILE)) == NULL)
+            break;
+
+        for (tocPos = 0; tocPos < 2016; tocPos += tocEntryPointer->length) {
+            tocEntryPointer = (struct dirTocEntry *)&dir[tocPos];
+            if (tocEntryPointer->length == 0)
+                break;
+
+            // Skip the '.' and '..' entries, and names that can never be looked up
+            if ((tocEntryPointer->filenameLength <= 1) || (tocEntryPointer->filenameLength >= sizeof(name)))
+                continue;
+
+            strncpy(name, tocEntryPointer->filename, tocEntryPointer->filenameLength);
+            name[tocEntryPointer->filenameLength] = '\0';
+
+            // Layer 1 locations are relative to the start of layer 1
+            lsn = tocEntryPointer->fileLBA + layer1_start;
+
+            cdvdman_path_hash(&key, name, -1, layer);
+            cdvdman_pathcache_add(&key, lsn, tocEntryPointer->fileSize, (tocEntryPointer->fileProperties & 2) ? PATHCACHE_DIR : 0);
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+// Add a directory to the index being built, growing it when needed.
+// Returns -1 when the index is full or can not grow.
+static int cdvdman_dirindex_add(dirindex_entry_t **dirs, unsigned int *max, const path_hash_t *key, u32 lsn, u32 size)
+{
+    dirindex_entry_t *grown;
+
+    if (dirindex_count == *max) {
+        if (*max >= DIRINDEX_MAX)
+            return -1;
+        grown = AllocSysMemory(0, (*max * 2) * sizeof(dirindex_entry_t), NULL);
+        if (grown == NULL)
+            return -1;
+        memcpy(grown, *dirs, *max * sizeof(dirindex_entry_t));
+        FreeSysMemory(*dirs);
+        *dirs = grown;
+        *max *= 2;
+    }
+
+    (*dirs)[dirindex_count].key = *key;
+    (*dirs)[dirindex_count].lsn = lsn;
+    (*dirs)[dirindex_count].size = size;
+    dirindex_count++;
+
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+static void cdvdman_dirindex_sift(dirindex_entry_t *dirs, unsigned int root, unsigned int count)
+{
+    dirindex_entry_t entry = dirs[root];
+    unsigned int child;
+
+    while ((child = root * 2 + 1) < count) {
+        if ((child + 1 < count) && (dirs[child + 1].key.hash > dirs[child].key.hash))
+            child++;
+        if (dirs[child].key.hash <= entry.key.hash)
+            break;
+        dirs[root] = dirs[child];
+        root = child;
+    }
+    dirs[root] = entry;
+}
+
+//-------------------------------------------------------------------------
+// Heap sort of the index by hash
+static void cdvdman_dirindex_sort(dirindex_entry_t *dirs, unsigned int count)
+{
+    dirindex_entry_t entry;
+    unsigned int i;
+
+    for (i = count / 2; i > 0; i--)
+        cdvdman_dirindex_sift(dirs, i - 1, count);
+
+    for (i = count; i > 1; i--) {
+        entry = dirs[0];
+        dirs[0] = dirs[i - 1];
+        dirs[i - 1] = entry;
+        cdvdman_dirindex_sift(dirs, 0, i - 1);
+    }
+}
+
+//-------------------------------------------------------------------------
+// Index the directories of the image, breadth first. Each directory is read only once.
+// The walk stops when the index is full, the directories indexed so far are kept.
+static void cdvdman_dirindex_build(void)
+{
+    dirindex_entry_t *dirs;
+    unsigned int max = 64, head, first, sector, i;
+    int layer, tocPos, layer1_start = 0, full = 0;
+    path_hash_t key;
+    u8 *dir;
+    struct dirTocEntry *tocEntryPointer;
+
+    dirindex_count = 0;
+    if ((dirs = AllocSysMemory(0, max * sizeof(dirindex_entry_t), NULL)) == NULL)
+        return;
+
+    for (layer = 0; (layer < 2) && !full; layer++) {
+        if (layer_info[layer].rootDirtocLBA == 0)
+            continue;
+
+        if (layer) {
+            int on_dual;
+            sceCdReadDvdDualInfo(&on_dual, (unsigned int *)&layer1_start);
+        }
+
+        // The root directory, with the initial (empty path) hash state
+        key.hash = 2166136261u;
+        key.check = 5381;
+        first = dirindex_count;
+        if (cdvdman_dirindex_add(&dirs, &max, &key, layer_info[layer].rootDirtocLBA, layer_info[layer].rootDirtocLength) < 0)
+            break;
+
+        // While building, the keys hold the hash state of the path without the layer
+        for (head = first; (head < dirindex_count) && !full; head++) {
+            for (sector = 0; ((sector * 2048) < dirs[head].size) && !full; sector++) {
+                if ((dir = cdvdman_window_sector(dirs[head].lsn, dirs[head].size, sector, window_sectors, ECS_SEARCHFILE)) == NULL)
+                    goto err;
+
+                for (tocPos = 0; tocPos < 2016; tocPos += tocEntryPointer->length) {
+                    tocEntryPointer = (struct dirTocEntry *)&dir[tocPos];
+                    if (tocEntryPointer->length == 0)
+                        break;
+
+                    // Only directories, skip the '.' and '..' entries
+                    if (!(tocEntryPointer->fileProperties & 2) || (tocEntryPointer->filenameLength <= 1))
+                        continue;
+
+                    key = dirs[head].key;
+                    if (head != first)
+                        cdvdman_path_hash_add(&key, "/", 1);
+                    cdvdman_path_hash_add(&key, tocEntryPointer->filename, tocEntryPointer->filenameLength);
+
+                    // Layer 1 locations are relative to the start of layer 1
+                    if (cdvdman_dirindex_add(&dirs, &max, &key, tocEntryPointer->fileLBA + layer1_start, tocEntryPointer->fileSize) < 0) {
+                        full = 1;
+                        break;
+                    }
+                }
+            }
+        }
+
+        for (i = first; i < dirindex_count; i++)
+            cdvdman_path_hash_end(&dirs[i].key, layer);
+    }
+
+    cdvdman_dirindex_sort(dirs, dirindex_count);
+
+    // Keep only the memory that is needed
+    dirindex = AllocSysMemory(0, dirindex_count * sizeof(dirindex_entry_t), NULL);
+    if (dirindex != NULL) {
+        memcpy(dirindex, dirs, dirindex_count * sizeof(dirindex_entry_t));
+        FreeSysMemory(dirs);
+    } else {
+        dirindex = dirs;
+    }
+
+    M_DEBUG("%s: %d directories%s\n", __FUNCTION__, dirindex_count, full ? " (full)" : "");
+    return;
+
+err:
+    M_DEBUG("%s: failed\n", __FUNCTION__);
+    FreeSysMemory(dirs);
+    dirindex_count = 0;
+}
+
 //-------------------------------------------------------------------------
 void cdvdman_searchfile_init(void)
 {
     // Read the volume descriptor
-    sceCdRead_internal(16, 1, cdvdman_buf, NULL, ECS_SEARCHFILE);
-    sceCdSync(0);
+    cdvdman_read_sync(16, 1, cdvdman_buf, ECS_SEARCHFILE);
 
     struct dirTocEntry *tocEntryPointer = (struct dirTocEntry *)&cdvdman_buf[0x9c];
     layer_info[0].rootDirtocLBA = tocEntryPointer->fileLBA;
@@ -244,8 +647,7 @@ void cdvdman_searchfile_init(void)
             //u32 lsn0 = mediaLsnCount;
             // So that CdRead below can read more than first layer.
             //mediaLsnCount = 0;
-            sceCdRead_internal(layer1_start + 16, 1, cdvdman_buf, NULL, ECS_SEARCHFILE);
-            sceCdSync(0);
+            cdvdman_read_sync(layer1_start + 16, 1, cdvdman_buf, ECS_SEARCHFILE);
             tocEntryPointer = (struct dirTocEntry *)&cdvdman_buf[0x9c];
             layer_info[1].rootDirtocLBA = layer1_start + tocEntryPointer->fileLBA;
             layer_info[1].rootDirtocLength = tocEntryPointer->fileSize;
@@ -257,4 +659,24 @@ void cdvdman_searchfile_init(void)
             //M_DEBUG("cdvdman_searchfile_init DVD9 mediaLsnCount=%d\n", mediaLsnCount);
         }
     }
+
+    // Directory extents are read in batches into the FSV buffer
+    WaitSema(cdvdman_searchfilesema);
+    if (cdvdman_fs_buf != NULL) {
+        window_buf = cdvdman_fs_buf;
+        window_sectors = cdvdman_settings.fs_sectors;
+    }
+    window_count = 0;
+
+    // Pre-populate the path cache with the root directory of each layer
+    memset(pathcache, 0, sizeof(pathcache));
+    cdvdman_pathcache_fill_root(0);
+    if (layer_info[1].rootDirtocLBA != 0)
+        cdvdman_pathcache_fill_root(1);
+
+    // The walk reads every directory. With accurate reads each of them takes the time of a real drive,
+    // so the index is only built with fast reads.
+    if (cdvdman_settings.flags & CDVDMAN_COMPAT_FAST_READS)
+        cdvdman_dirindex_build();
+    SignalSema(cdvdman_searchfilesema);
 }
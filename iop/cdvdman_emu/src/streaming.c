@@ -7,27 +7,123 @@
 #include "internal.h"
 #include "cdvdman_read.h"
 
+// Maximum number of banks queued to the read thread at the same time.
+// Leaves room in the read queue for other requests.
+#define ST_MAX_BANKS_QUEUED 6
+// The read queue is processed in order, so while other requests are pending only a few
+// banks are queued. Otherwise a game read would wait for all queued banks to be read.
+#define ST_MAX_BANKS_SHARED 2
+
+// Without underruns for this long, the minimum depth is lowered again (4 seconds of system clock)
+#define ST_UNDERRUN_DECAY_CLK (4 * 36864000)
+
+#define ST_BANK_BIT(ptr)  (1 << (((ptr) / cdvdman_stat.StreamingData.StBanksize) & 31))
+#define ST_BANK_SLOT(ptr) (((ptr) / cdvdman_stat.StreamingData.StBanksize) % ST_MAX_BANKS_QUEUED)
+
+// Streaming auto-tuning: the number of banks to keep queued and the refill trigger
+// follow the measured speed of the backing store and of the game.
+static struct
+{
+    unsigned int depth;                  // Number of banks to keep queued
+    unsigned int min_depth;              // Raised on every underrun, lowered after a period without
+    unsigned int low_water;              // Start refilling when fewer sectors are buffered or queued
+    unsigned char refilling;             // Refilling, until the ring buffer is full
+    u32 refill_clk;                      // Average time to read one bank
+    u32 bank_clk;                        // Average time the game takes to consume one bank
+    u32 started_at[ST_MAX_BANKS_QUEUED]; // Time the read thread started on each queued bank
+    u32 last_read;                       // Time of the last sceCdStRead that returned data
+    u32 last_underrun;                   // Time of the last underrun, or of the last decay of min_depth
+} st_tune;
+
 static int AllocBank(void **pointer);
 static int ReadSectors(int maxcount, void *buffer);
 static int StFillStreamBuffer(void);
+static void StWaitDma(void);
 static void StStartFillStreamBuffer(void);
 
+static u32 StClk2USec(u32 clk)
+{
+    iop_sys_clock_t clock;
+    u32 sec, usec;
+
+    clock.lo = clk;
+    clock.hi = 0;
+    SysClock2USec(&clock, &sec, &usec);
+
+    return sec * 1000000 + usec;
+}
+
+// Pick the number of banks to keep queued: enough to cover the time it takes to read a bank.
+// Must be called from an interrupt-disabled state.
+static void StTuneUpdate(void)
+{
+    unsigned int depth, max_depth;
+
+    // Always leave one bank for the game to read from
+    max_depth = cdvdman_stat.StreamingData.StBankmax - 1;
+    if (max_depth > ST_MAX_BANKS_QUEUED)
+        max_depth = ST_MAX_BANKS_QUEUED;
+    if (max_depth < 1)
+        max_depth = 1;
+
+    // Until the game has been measured, queue as much as possible
+    depth = (st_tune.bank_clk > 0) ? (st_tune.refill_clk / st_tune.bank_clk + 1) : max_depth;
+    if (depth < st_tune.min_depth)
+        depth = st_tune.min_depth;
+    if (depth > max_depth)
+        depth = max_depth;
+    st_tune.depth = depth;
+
+    // Refill while the buffered data still covers the reading of the queued banks
+    st_tune.low_water = (st_tune.bank_clk > 0) ? ((depth + 1) * cdvdman_stat.StreamingData.StBanksize) : cdvdman_stat.StreamingData.StBufmax;
+    if (st_tune.low_water > cdvdman_stat.StreamingData.StBufmax)
+        st_tune.low_water = cdvdman_stat.StreamingData.StBufmax;
+
+    cdvdman_read_stats.st_depth = st_tune.depth;
+    cdvdman_read_stats.st_low_water = st_tune.low_water;
+    cdvdman_read_stats.st_refill_usec = StClk2USec(st_tune.refill_clk);
+    cdvdman_read_stats.st_bank_usec = StClk2USec(st_tune.bank_clk);
+}
+
+// Must be called from an interrupt-disabled state.
+static void StTuneSample(u32 *average, u32 sample)
+{
+    *average = (*average == 0) ? sample : ((*average * 3 + sample) / 4);
+}
+
+// Refill from the read thread, after a transfer to EE RAM or a failed refill
+static void StDeferredFill(void)
+{
+    if (cdvdman_stat.StreamingData.StStat)
+        StStartFillStreamBuffer();
+}
+
 static unsigned int StmScheduleCb(void *arg)
 {
-    return ((StFillStreamBuffer() >= 0) ? 0 : 0x00704000);
+    cdvdman_read_defer(&StDeferredFill);
+    return 0;
 }
 
 static void StmCallback(void)
 {
     int OldState;
+    u32 now;
 
+    // Banks complete in the order they were queued, so the completed bank is always at the write pointer
     CpuSuspendIntr(&OldState);
-    cdvdman_stat.StreamingData.Stlsn += cdvdman_stat.StreamingData.StBanksize;
+    now = GetSystemTimeLow();
+    StTuneSample(&st_tune.refill_clk, now - st_tune.started_at[ST_BANK_SLOT(cdvdman_stat.StreamingData.StWritePtr)]);
+    StTuneUpdate();
+    cdvdman_stat.StreamingData.StBankBusy &= ~ST_BANK_BIT(cdvdman_stat.StreamingData.StWritePtr);
+    cdvdman_stat.StreamingData.StPending -= cdvdman_stat.StreamingData.StBanksize;
     cdvdman_stat.StreamingData.StStreamed += cdvdman_stat.StreamingData.StBanksize;
     cdvdman_stat.StreamingData.StWritePtr += cdvdman_stat.StreamingData.StBanksize;
     if (cdvdman_stat.StreamingData.StWritePtr >= cdvdman_stat.StreamingData.StBufmax)
         cdvdman_stat.StreamingData.StWritePtr = 0;
-    cdvdman_stat.StreamingData.StIsReading = 0;
+    // The next queued bank is started now, not when it was queued: the time spent waiting
+    // behind the other banks would make a deeper queue look like a slower device.
+    if (cdvdman_stat.StreamingData.StPending > 0)
+        st_tune.started_at[ST_BANK_SLOT(cdvdman_stat.StreamingData.StWritePtr)] = now;
     CpuResumeIntr(OldState);
 
     //M_DEBUG("StmCallback: %08lx, wr: %u, rd: %u, streamed: %u\n", cdvdman_stat.StreamingData.Stlsn, cdvdman_stat.StreamingData.StWritePtr, cdvdman_stat.StreamingData.StReadPtr, cdvdman_stat.StreamingData.StStreamed);
@@ -41,16 +137,32 @@ static void StReset(void)
     cdvdman_stat.StreamingData.StReadPtr = 0;
     cdvdman_stat.StreamingData.StStreamed = 0;
     cdvdman_stat.StreamingData.StIsReading = 0;
+    cdvdman_stat.StreamingData.StFillPtr = 0;
+    cdvdman_stat.StreamingData.StPending = 0;
+    cdvdman_stat.StreamingData.StBankBusy = 0;
+}
+
+// Forget the queued banks after they have been read without StmCallback, so they will be queued again.
+// Must be called from an interrupt-disabled state.
+static void StCancelPending(void)
+{
+    cdvdman_stat.StreamingData.Stlsn -= cdvdman_stat.StreamingData.StPending;
+    cdvdman_stat.StreamingData.StFillPtr = cdvdman_stat.StreamingData.StWritePtr;
+    cdvdman_stat.StreamingData.StPending = 0;
+    cdvdman_stat.StreamingData.StBankBusy = 0;
+    cdvdman_stat.StreamingData.StIsReading = 0;
 }
 
 // 0 = OK. <0 = error in sceCdRead. >0 = full buffer.
 static int StFillStreamBuffer(void)
 {
     int result, OldState;
+    unsigned short int fillptr;
+    u32 lsn;
     void *ptr;
 
-    /*	SCEI used a similar design, but their implementation uses a bitmap to mark the filled/empty banks instead
-    (which is probably immune to race conditions, but we are interested in saving memory).	*/
+    /*	Like SCEI, keep a bitmap of the banks that are being filled. Several banks are queued to the read thread at once,
+        so the latency of the backing store is hidden while the ring buffer is drained.	*/
     CpuSuspendIntr(&OldState);
 
     if (cdvdman_stat.StreamingData.StIsReading) {
@@ -59,29 +171,66 @@ static int StFillStreamBuffer(void)
     }
 
     CancelAlarm(&StmScheduleCb, &cdvdman_stat.StreamingData);
+
+    // Wait for the low-water mark before refilling
+    if (!st_tune.refilling) {
+        if ((cdvdman_stat.StreamingData.StStreamed + cdvdman_stat.StreamingData.StPending) > st_tune.low_water) {
+            CpuResumeIntr(OldState);
+            return 1;
+        }
+        st_tune.refilling = 1;
+    }
+
     cdvdman_stat.StreamingData.StIsReading = 1;
 
-    // Determine how much more to read.
-    result = AllocBank(&ptr);
+    result = 1;
+    while (1) {
+        // Determine how much more to read.
+        if (AllocBank(&ptr) != 0) {
+            // Refill until the ring buffer is full
+            if (cdvdman_stat.StreamingData.StBufmax - cdvdman_stat.StreamingData.StStreamed - cdvdman_stat.StreamingData.StPending < cdvdman_stat.StreamingData.StBanksize)
+                st_tune.refilling = 0;
 
-    CpuResumeIntr(OldState);
+            // Stop queuing, without releasing the interrupts after the last check
+            cdvdman_stat.StreamingData.StIsReading = 0;
+            CpuResumeIntr(OldState);
+            break;
+        }
 
-    if (result == 0) {
-        // M_DEBUG("Stream fill buffer: Stream lsn 0x%08x - %u sectors:%p\n", cdvdman_stat.StreamingData.Stlsn, cdvdman_stat.StreamingData.StBanksize, ptr);
-        if (sceCdRead_internal(cdvdman_stat.StreamingData.Stlsn, cdvdman_stat.StreamingData.StBanksize, ptr, NULL, ECS_STREAMING) == 0) {
-            // Failed to start reading.
+        // Take the bank
+        fillptr = cdvdman_stat.StreamingData.StFillPtr;
+        lsn = cdvdman_stat.StreamingData.Stlsn;
+        cdvdman_stat.StreamingData.StBankBusy |= ST_BANK_BIT(fillptr);
+        if (cdvdman_stat.StreamingData.StPending == 0)
+            st_tune.started_at[ST_BANK_SLOT(fillptr)] = GetSystemTimeLow();
+        cdvdman_stat.StreamingData.StPending += cdvdman_stat.StreamingData.StBanksize;
+        cdvdman_stat.StreamingData.Stlsn += cdvdman_stat.StreamingData.StBanksize;
+        cdvdman_stat.StreamingData.StFillPtr += cdvdman_stat.StreamingData.StBanksize;
+        if (cdvdman_stat.StreamingData.StFillPtr >= cdvdman_stat.StreamingData.StBufmax)
+            cdvdman_stat.StreamingData.StFillPtr = 0;
+        CpuResumeIntr(OldState);
+
+        // M_DEBUG("Stream fill buffer: Stream lsn 0x%08x - %u sectors:%p\n", lsn, cdvdman_stat.StreamingData.StBanksize, ptr);
+        if (sceCdRead_internal(lsn, cdvdman_stat.StreamingData.StBanksize, ptr, NULL, ECS_STREAMING) == 0) {
+            // Failed to start reading, give the bank back. It is the last bank queued, because only we can queue banks.
+            CpuSuspendIntr(&OldState);
+            cdvdman_stat.StreamingData.StBankBusy &= ~ST_BANK_BIT(fillptr);
+            cdvdman_stat.StreamingData.StPending -= cdvdman_stat.StreamingData.StBanksize;
+            cdvdman_stat.StreamingData.Stlsn = lsn;
+            cdvdman_stat.StreamingData.StFillPtr = fillptr;
             cdvdman_stat.StreamingData.StIsReading = 0;
+            CpuResumeIntr(OldState);
             result = -1;
-        } else {
-            result = 0;
+            break;
         }
-    } else {
-        M_DEBUG("Stream fill buffer: Stream full.\n");
-        // Nothing else to read.
-        cdvdman_stat.StreamingData.StIsReading = 0;
-        result = 1;
+        result = 0;
+
+        CpuSuspendIntr(&OldState);
     }
 
+    if (result > 0)
+        M_DEBUG("Stream fill buffer: Stream full.\n");
+
     return result;
 }
 
@@ -108,6 +257,7 @@ int sceCdStInit(u32 bufmax, u32 bankmax, void *iop_bufaddr)
     cdvdman_stat.err = SCECdErNO;
 
     CancelAlarm(&StmScheduleCb, &cdvdman_stat.StreamingData);
+    StWaitDma();
 
     CpuSuspendIntr(&OldState);
     cdvdman_stat.StreamingData.StBankmax = bankmax;
@@ -116,6 +266,10 @@ int sceCdStInit(u32 bufmax, u32 bankmax, void *iop_bufaddr)
     cdvdman_stat.StreamingData.StIOP_bufaddr = iop_bufaddr;
     StReset();
 
+    // New buffer layout, measure again
+    memset(&st_tune, 0, sizeof(st_tune));
+    StTuneUpdate();
+
     CpuResumeIntr(OldState);
 
     //M_DEBUG("sceCdStInit bufmax: %u (%lu), bankmax: %lu, banksize: %u, buffer: %p\n", cdvdman_stat.StreamingData.StBufmax, bufmax, bankmax, cdvdman_stat.StreamingData.StBanksize, iop_bufaddr);
@@ -126,94 +280,117 @@ int sceCdStInit(u32 bufmax, u32 bankmax, void *iop_bufaddr)
 // Must be called from an interrupt-disabled state.
 static int AllocBank(void **pointer)
 {
+    unsigned int depth;
     int result;
 
     //M_DEBUG("%s\n", __FUNCTION__);
 
-    if (cdvdman_stat.StreamingData.StBufmax - cdvdman_stat.StreamingData.StStreamed >= cdvdman_stat.StreamingData.StBanksize) {
-        *pointer = cdvdman_stat.StreamingData.StIOP_bufaddr + cdvdman_stat.StreamingData.StWritePtr * 2048;
+    depth = st_tune.depth;
+    if ((cdvdman_read_others_pending > 0) && (depth > ST_MAX_BANKS_SHARED))
+        depth = ST_MAX_BANKS_SHARED;
+
+    // The bank must be free: not holding data that was not read yet, and not queued for reading
+    if ((cdvdman_stat.StreamingData.StBufmax - cdvdman_stat.StreamingData.StStreamed - cdvdman_stat.StreamingData.StPending >= cdvdman_stat.StreamingData.StBanksize) &&
+        (cdvdman_stat.StreamingData.StPending < depth * cdvdman_stat.StreamingData.StBanksize) &&
+        !(cdvdman_stat.StreamingData.StBankBusy & ST_BANK_BIT(cdvdman_stat.StreamingData.StFillPtr))) {
+        *pointer = cdvdman_stat.StreamingData.StIOP_bufaddr + cdvdman_stat.StreamingData.StFillPtr * 2048;
         result = 0;
     } else {
         *pointer = NULL;
         result = -ENOMEM;
     }
 
-    //M_DEBUG("AllocBank: wrptr: %u, rdptr: %u, streamed: %u\n", cdvdman_stat.StreamingData.StWritePtr, cdvdman_stat.StreamingData.StReadPtr, cdvdman_stat.StreamingData.StStreamed);
+    //M_DEBUG("AllocBank: fillptr: %u, wrptr: %u, rdptr: %u, streamed: %u, pending: %u\n", cdvdman_stat.StreamingData.StFillPtr, cdvdman_stat.StreamingData.StWritePtr, cdvdman_stat.StreamingData.StReadPtr, cdvdman_stat.StreamingData.StStreamed, cdvdman_stat.StreamingData.StPending);
 
     return result;
 }
 
+// Called from the interrupt handler when a transfer to EE RAM has completed
+static void ReadSectorsEEDone(void *arg)
+{
+    unsigned short int count = (unsigned short int)(u32)arg;
+
+    // Transfers complete in order, so the sectors are always at the read pointer
+    cdvdman_stat.StreamingData.StReadPtr += count;
+    if (cdvdman_stat.StreamingData.StReadPtr >= cdvdman_stat.StreamingData.StBufmax)
+        cdvdman_stat.StreamingData.StReadPtr -= cdvdman_stat.StreamingData.StBufmax;
+    cdvdman_stat.StreamingData.StStreamed -= count;
+    cdvdman_stat.StreamingData.StDmaPending -= count;
+
+    iSetEventFlag(cdvdman_stat.intr_ef, CDVDEF_STM_DONE | CDVDEF_STM_DMA);
+
+    // The sectors are free now, refill them from the read thread
+    if (cdvdman_stat.StreamingData.StStat)
+        cdvdman_read_defer(&StDeferredFill);
+}
+
+// Wait for all transfers to EE RAM to complete, before the ring buffer is reset
+static void StWaitDma(void)
+{
+    int OldState;
+
+    while (1) {
+        CpuSuspendIntr(&OldState);
+        if (cdvdman_stat.StreamingData.StDmaPending == 0) {
+            CpuResumeIntr(OldState);
+            break;
+        }
+        ClearEventFlag(cdvdman_stat.intr_ef, ~CDVDEF_STM_DMA);
+        CpuResumeIntr(OldState);
+
+        WaitEventFlag(cdvdman_stat.intr_ef, CDVDEF_STM_DMA, WEF_AND, NULL);
+    }
+}
+
 static int ReadSectorsEE(int maxcount, void *buffer)
 {
-    int OldState, result, dmat_id, dmat_count;
+    int OldState, result, dmat_count;
     unsigned short int SectorsToCopy, rdptr;
     SifDmaTransfer_t dmat[2];
-    void *ptr;
 
-    //	M_DEBUG("ReadSectors EE: wr: %u, rd: %u, streamed: %u\n", cdvdman_stat.StreamingData.StWritePtr, cdvdman_stat.StreamingData.StReadPtr, cdvdman_stat.StreamingData.StStreamed);
+    //	M_DEBUG("ReadSectors EE: wr: %u, rd: %u, streamed: %u, dma: %u\n", cdvdman_stat.StreamingData.StWritePtr, cdvdman_stat.StreamingData.StReadPtr, cdvdman_stat.StreamingData.StStreamed, cdvdman_stat.StreamingData.StDmaPending);
 
-    result = 0;
-    ptr = buffer;
     dmat_count = 0;
-    dmat_id = 0;
 
     CpuSuspendIntr(&OldState);
-    rdptr = cdvdman_stat.StreamingData.StReadPtr;
 
-    // When Wr <= Rd, the buffer is either full or empty. Check StStreamed.
-    if (cdvdman_stat.StreamingData.StWritePtr <= rdptr && cdvdman_stat.StreamingData.StStreamed > 0) {
+    // Sectors still being transferred by a previous call are skipped
+    result = cdvdman_stat.StreamingData.StStreamed - cdvdman_stat.StreamingData.StDmaPending;
+    if (result > maxcount)
+        result = maxcount;
+    rdptr = cdvdman_stat.StreamingData.StReadPtr + cdvdman_stat.StreamingData.StDmaPending;
+    if (rdptr >= cdvdman_stat.StreamingData.StBufmax)
+        rdptr -= cdvdman_stat.StreamingData.StBufmax;
+
+    if (result > 0) {
+        // Up to the end of the ring buffer
         SectorsToCopy = cdvdman_stat.StreamingData.StBufmax - rdptr;
-        if (SectorsToCopy > maxcount)
-            SectorsToCopy = maxcount;
-        if (SectorsToCopy > 0) {
-            dmat[0].src = cdvdman_stat.StreamingData.StIOP_bufaddr + rdptr * 2048;
-            dmat[0].dest = buffer;
-            dmat[0].size = SectorsToCopy * 2048;
-            dmat[0].attr = 0;
-            dmat_count = 1;
-            ptr += SectorsToCopy * 2048;
-            rdptr += SectorsToCopy;
-            if (rdptr >= cdvdman_stat.StreamingData.StBufmax)
-                rdptr = 0;
-            result += SectorsToCopy;
+        if (SectorsToCopy > result)
+            SectorsToCopy = result;
+        dmat[0].src = cdvdman_stat.StreamingData.StIOP_bufaddr + rdptr * 2048;
+        dmat[0].dest = buffer;
+        dmat[0].size = SectorsToCopy * 2048;
+        dmat[0].attr = 0;
+        dmat_count = 1;
+
+        // And the rest from the start of the ring buffer
+        if (SectorsToCopy < result) {
+            dmat[1].src = cdvdman_stat.StreamingData.StIOP_bufaddr;
+            dmat[1].dest = buffer + SectorsToCopy * 2048;
+            dmat[1].size = (result - SectorsToCopy) * 2048;
+            dmat[1].attr = 0;
+            dmat_count = 2;
         }
-    }
-    // When Rd < Wr, there are sectors in the buffer.
-    if (result < maxcount && rdptr < cdvdman_stat.StreamingData.StWritePtr) {
-        SectorsToCopy = cdvdman_stat.StreamingData.StWritePtr - rdptr;
-        if (SectorsToCopy > maxcount - result)
-            SectorsToCopy = maxcount - result;
-        if (SectorsToCopy > 0) {
-            dmat[dmat_count].src = cdvdman_stat.StreamingData.StIOP_bufaddr + rdptr * 2048;
-            dmat[dmat_count].dest = ptr;
-            dmat[dmat_count].size = SectorsToCopy * 2048;
-            dmat[dmat_count].attr = 0;
-            dmat_count++;
-            rdptr += SectorsToCopy;
-            if (rdptr >= cdvdman_stat.StreamingData.StBufmax)
-                rdptr = 0;
-            result += SectorsToCopy;
-        }
-    }
 
-    if (dmat_count > 0)
-        while ((dmat_id = sceSifSetDma(dmat, dmat_count)) == 0) {
+        // The read pointer is advanced by ReadSectorsEEDone, when the data has left the ring buffer
+        cdvdman_stat.StreamingData.StDmaPending += result;
+        while (sceSifSetDmaIntr(dmat, dmat_count, &ReadSectorsEEDone, (void *)result) == 0) {
         };
+    } else
+        result = 0;
 
     CpuResumeIntr(OldState);
 
-    if (dmat_count > 0) // Only if there is data to copy
-    {
-        while (sceSifDmaStat(dmat_id) >= 0) {
-        };
-
-        // Finally, update variables.
-        CpuSuspendIntr(&OldState);
-        cdvdman_stat.StreamingData.StReadPtr = rdptr;
-        cdvdman_stat.StreamingData.StStreamed -= result;
-        CpuResumeIntr(OldState);
-    }
-
     return result;
 }
 
@@ -229,6 +406,12 @@ static int ReadSectors(int maxcount, void *buffer)
     ptr = buffer;
     CpuSuspendIntr(&OldState);
 
+    // Do not overtake a transfer to EE RAM, try again when it has completed
+    if (cdvdman_stat.StreamingData.StDmaPending > 0) {
+        CpuResumeIntr(OldState);
+        return 0;
+    }
+
     // When Wr <= Rd, the buffer is either full or empty. Check StStreamed.
     if (cdvdman_stat.StreamingData.StWritePtr <= cdvdman_stat.StreamingData.StReadPtr && cdvdman_stat.StreamingData.StStreamed > 0) {
         SectorsToCopy = cdvdman_stat.StreamingData.StBufmax - cdvdman_stat.StreamingData.StReadPtr;
@@ -277,6 +460,8 @@ int sceCdStStart(u32 lsn, sceCdRMode *mode)
     cdvdman_stat.StreamingData.Stlsn = lsn;
     cdvdman_stat.StreamingData.StStat = 1;
     StReset();
+    st_tune.refilling = 0;
+    st_tune.last_read = 0;
     cdvdman_read_set_stm0_callback(&StmCallback);
     CpuResumeIntr(OldState);
 
@@ -305,6 +490,7 @@ int sceCdStStop(void)
     cdvdman_stat.status = SCECdStatPause;
     if (cdvdman_stat.StreamingData.StStat) {
         CancelAlarm(&StmScheduleCb, &cdvdman_stat.StreamingData);
+        StWaitDma();
 
         CpuSuspendIntr(&OldState);
 
@@ -336,11 +522,15 @@ int sceCdStPause(void)
         CpuSuspendIntr(&OldState);
         // Pause.
         cdvdman_read_set_stm0_callback(NULL);
-        cdvdman_stat.StreamingData.StIsReading = 0;
         CpuResumeIntr(OldState);
 
         sceCdSync(0);
 
+        // The queued banks have been read without the callback, queue them again on resume
+        CpuSuspendIntr(&OldState);
+        StCancelPending();
+        CpuResumeIntr(OldState);
+
         return 1;
     } else {
         return 0;
@@ -384,7 +574,8 @@ int sceCdStSeek(u32 lsn)
 
 int sceCdStRead(u32 sectors, u32 *buffer, u32 mode, u32 *error)
 {
-    int SectorsRead, SectorsToRead, result;
+    int SectorsRead, SectorsToRead, result, OldState;
+    u32 now;
     void *ptr;
 
     M_DEBUG("%s(%lu, 0x%X, %lu, 0x%x)\n", __FUNCTION__, sectors, buffer, mode, error);
@@ -404,8 +595,37 @@ int sceCdStRead(u32 sectors, u32 *buffer, u32 mode, u32 *error)
                 SectorsRead = ReadSectors(SectorsToRead, ptr);
             //		M_DEBUG(", Read: %u\n", SectorsRead);
 
-            if (SectorsRead == 0)
-                M_DEBUG("StRead: buffer underrun. %u/%lu read.\n", result, sectors);
+            CpuSuspendIntr(&OldState);
+            now = GetSystemTimeLow();
+            if (SectorsRead == 0) {
+                // Only an empty ring buffer is an underrun, not sectors that are still being transferred to EE RAM
+                if ((cdvdman_stat.StreamingData.StStreamed == 0) && (cdvdman_stat.StreamingData.StDmaPending == 0)) {
+                    M_DEBUG("StRead: buffer underrun. %u/%lu read.\n", result, sectors);
+                    cdvdman_read_stats.st_underruns++;
+
+                    // Keep more banks queued from now on, and refill right away
+                    if (st_tune.min_depth < ST_MAX_BANKS_QUEUED)
+                        st_tune.min_depth++;
+                    st_tune.last_underrun = now;
+                    st_tune.refilling = 1;
+                    StTuneUpdate();
+                }
+            } else {
+                // Measure how fast the game consumes the stream
+                if (st_tune.last_read != 0) {
+                    StTuneSample(&st_tune.bank_clk, (now - st_tune.last_read) / SectorsRead * cdvdman_stat.StreamingData.StBanksize);
+                    StTuneUpdate();
+                }
+                st_tune.last_read = now;
+
+                // The extra depth is not needed anymore, give one bank back
+                if ((st_tune.min_depth > 0) && ((now - st_tune.last_underrun) > ST_UNDERRUN_DECAY_CLK)) {
+                    st_tune.min_depth--;
+                    st_tune.last_underrun = now;
+                    StTuneUpdate();
+                }
+            }
+            CpuResumeIntr(OldState);
 
             result += SectorsRead;
             // if(mode == STMNBLK) break;
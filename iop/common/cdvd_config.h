@@ -29,6 +29,8 @@ struct cdvdman_settings_common
         u8 disk_id[5];
         u64 disk_id_int; // 8 bytes, but that's ok for compare reasons
     };
+
+    u8 ra_sectors; // Number of sectors to allocate for read-ahead cache (0 = disabled)
 } __attribute__((packed));
 
 #endif
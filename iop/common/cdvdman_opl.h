@@ -60,12 +60,51 @@ enum CDIOC_CODE {
     CDIOC_INIT,
 
     CDIOC_GETINTREVENTFLG = CDIOC_FNUM(0x91),
+
+    // OPL extensions
+    CDIOC_GETREADSTATS = CDIOC_FNUM(0xA0), // Copy struct cdvdman_read_stats to buf
+    CDIOC_RESETREADSTATS,                  // Clear all read statistics
+};
+
+// Read path statistics, returned by CDIOC_GETREADSTATS
+#define CDVDMAN_STATS_SOURCES   4  // Indexed by enum ECallSource: external, searchfile, streaming, EE RPC
+#define CDVDMAN_STATS_SIZES     8  // Indexed by log2(sectors): 1, 2-3, 4-7, ... 128+ sectors
+#define CDVDMAN_STATS_LAT_BINS  16 // Indexed by log2(usec): <2us, <4us, ... >=32ms
+
+struct cdvdman_read_stats_counter
+{
+    u32 requests;
+    u32 sectors;
+    u64 usec;
+};
+
+struct cdvdman_read_stats
+{
+    struct cdvdman_read_stats_counter source[CDVDMAN_STATS_SOURCES];
+    struct cdvdman_read_stats_counter size[CDVDMAN_STATS_SIZES];
+    struct cdvdman_read_stats_counter direct; // 2048-byte sectors to an aligned buffer
+    struct cdvdman_read_stats_counter bounce; // Unaligned buffer or 2328/2340-byte sectors
+    u32 latency[CDVDMAN_STATS_SOURCES][CDVDMAN_STATS_LAT_BINS];
+    u32 ra_sectors;     // Sectors served from the read-ahead cache
+    u32 device_reads;   // Read commands sent to the device
+    u32 device_errors;  // Read commands that failed
+    u32 locked_rejects; // Commands rejected because a read was in progress (sync_flag_locked)
+    u32 queue_full;     // Read requests rejected because the queue was full
+    u32 st_underruns;   // sceCdStRead calls that found no data in the stream buffer
+    u32 st_depth;       // Streaming banks kept queued, picked by the auto-tuning
+    u32 st_low_water;   // Streaming refills when fewer sectors are buffered or queued
+    u32 st_refill_usec; // Average time to read one streaming bank
+    u32 st_bank_usec;   // Average time the game takes to consume one streaming bank
 };
 
 void *sceGetFsvRbuf2(int *size);
 
+// Bits of the CDVDMAN event flag (CDSC_GET_INTRFLAG) that other modules can wait on
+#define CDVDEF_READ_POS 0x0020 // The read position (sceCdGetReadPos) has advanced, or a read has completed
+
 // Codes for use with sceCdSC()
 #define CDSC_GET_DEBUG_STATUS 0xFFFFFFF0 // Get debug status flag.
+#define CDSC_QUEUE_READS      0xFFFFFFF4 // Queue the sceCdRead calls of this thread while busy (param != 0), instead of failing.
 #define CDSC_GET_INTRFLAG     0xFFFFFFF5 // Get interrupt flag.
 #define CDSC_IO_SEMA          0xFFFFFFF6 // Wait (param != 0) or signal (param == 0) high-level I/O semaphore.
 #define CDSC_GET_VERSION      0xFFFFFFF7 // Get CDVDMAN version.
@@ -14,6 +14,11 @@
 #define FHI_FID_MC0     4
 #define FHI_FID_MC1     5
 
+// Request priorities, higher priorities are serviced first
+#define FHI_PRIO_LOW    -1
+#define FHI_PRIO_NORMAL  0
+#define FHI_PRIO_HIGH    1
+
 #ifdef _IOP
 
 #include <stdint.h>
@@ -26,12 +31,66 @@ int fhi_read(int file_handle, void *buffer, unsigned int sector_start, unsigned
 // Write SECTORS to file
 int fhi_write(int file_handle, const void *buffer, unsigned int sector_start, unsigned int sector_count);
 
+/*
+ * FHI v2: asynchronous requests
+ *
+ * The caller owns the request descriptor and must keep it valid until the
+ * request is done. Requests are serviced by the FHI thread, higher priorities
+ * first, unless the scheduling policy of the FHI module says otherwise.
+ * The callback runs in the thread that completes the request, with the
+ * device locked: it must not block or call the synchronous FHI functions.
+ * It may submit new requests.
+ *
+ * All functions signal or wait on semaphores, so they must be called from
+ * thread context, never from an interrupt handler or alarm callback.
+ */
+struct fhi_request;
+typedef void (*fhi_callback_t)(struct fhi_request *req);
+
+struct fhi_request
+{
+    int file_handle;           /// FHI_FID_*
+    void *buffer;              /// Data buffer
+    unsigned int sector_start; /// First sector of 512b
+    unsigned int sector_count; /// Number of sectors of 512b
+    int priority;              /// FHI_PRIO_*
+    fhi_callback_t callback;   /// Optional, called on completion
+    void *arg;                 /// Request tag, for use by the caller
+    int result;                /// Sectors transferred or <0 on error, valid when done
+
+    // Private to the FHI module
+    struct fhi_request *next;
+    volatile int state;    /// FHI_REQ_*
+    int write;
+    unsigned int progress; /// Sectors transferred so far
+};
+
+#define FHI_REQ_DONE   0
+#define FHI_REQ_QUEUED 1
+#define FHI_REQ_BUSY   2
+
+// Queue a read request, returns 0 on success or <0 on error
+int fhi_read_async(struct fhi_request *req);
+// Queue a write request, returns 0 on success or <0 on error
+int fhi_write_async(struct fhi_request *req);
+// Returns 1 if the request is done, 0 if it is still pending
+int fhi_poll(struct fhi_request *req);
+// Wait for a request to complete, returns the request result
+int fhi_wait(struct fhi_request *req);
+
 #define fhi_IMPORTS_start DECLARE_IMPORT_TABLE(fhi, 1, 1)
 #define fhi_IMPORTS_end END_IMPORT_TABLE
+// Modules using the v2 exports need at least version 1.2
+#define fhi_v2_IMPORTS_start DECLARE_IMPORT_TABLE(fhi, 1, 2)
+#define fhi_v2_IMPORTS_end END_IMPORT_TABLE
 
 #define I_fhi_size DECLARE_IMPORT(4, fhi_size)
 #define I_fhi_read DECLARE_IMPORT(5, fhi_read)
 #define I_fhi_write DECLARE_IMPORT(6, fhi_write)
+#define I_fhi_read_async DECLARE_IMPORT(7, fhi_read_async)
+#define I_fhi_write_async DECLARE_IMPORT(8, fhi_write_async)
+#define I_fhi_poll DECLARE_IMPORT(9, fhi_poll)
+#define I_fhi_wait DECLARE_IMPORT(10, fhi_wait)
 
 #endif // _IOP
 #endif // FHI_H
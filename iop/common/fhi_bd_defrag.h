@@ -8,14 +8,30 @@
 #include "fhi.h"
 
 
-#define BDM_MAX_FRAGS 64 // 64 * 12bytes = 768bytes
+#define BDM_MAX_EXTENTS 256 // 256 * 8bytes = 2KiB
 
+// Request scheduler policy
+#define FHI_SCHED_CDVD_FIRST (1 << 0) /// Service CDVD requests before other files
+#define FHI_SCHED_COALESCE   (1 << 1) /// Merge and continue adjacent writes
+#define FHI_SCHED_ELEVATOR   (1 << 2) /// Order requests by device sector
+#define FHI_SCHED_DEFAULT    (FHI_SCHED_CDVD_FIRST | FHI_SCHED_COALESCE | FHI_SCHED_ELEVATOR)
+
+#define FHI_WRITE_CHUNK_DEFAULT 128 // 128 * 512bytes = 64KiB
+
+
+// Extents are the fragments of a file, with adjacent fragments merged
+struct fhi_bd_defrag_extent
+{
+    uint32_t end;    /// File sector where the extent ends, cumulative over the file
+    uint32_t sector; /// Device sector where the extent starts, relative to sector_base
+} __attribute__((packed));
 
 struct fhi_bd_defrag_info
 {
-    uint8_t frag_start; /// First fragment in the fragment table
-    uint8_t frag_count; /// Number of fragments in the fragment table
-    uint64_t size;      /// Size of the file in bytes
+    uint64_t sector_base; /// Lowest device sector of the file
+    uint16_t ext_start;   /// First extent in the extent table
+    uint16_t ext_count;   /// Number of extents in the extent table
+    uint64_t size;        /// Size of the file in bytes
 } __attribute__((packed));
 
 struct fhi_bd_defrag
@@ -26,12 +42,15 @@ struct fhi_bd_defrag
     uint32_t drvName; /// Driver name: usb, ata, sdc, etc...
     uint32_t devNr;   /// Device number: 0, 1, 2, etc...
 
+    uint16_t sched_flags; /// Scheduler policy: FHI_SCHED_*
+    uint16_t write_chunk; /// Max sectors written at once, 0 = unlimited
+
     // Fragmented files:
     // 0 = ISO
     struct fhi_bd_defrag_info file[FHI_MAX_FILES];
 
-    // Fragment table, containing the fragments of all files
-    bd_fragment_t frags[BDM_MAX_FRAGS];
+    // Extent table, containing the extents of all files
+    struct fhi_bd_defrag_extent extents[BDM_MAX_EXTENTS];
 } __attribute__((packed));
 
 
@@ -0,0 +1,190 @@
+#include <intrman.h>
+#include <stdio.h>
+#include <thsemap.h>
+#include <thbase.h>
+
+#include "fhi_queue.h"
+#include "mprintf.h"
+
+#define MODNAME "fhi"
+
+static int fhi_io_sema;
+static int fhi_queue_sema;
+
+//---------------------------------------------------------------------------
+void fhi_list_insert(struct fhi_request **list, struct fhi_request *req)
+{
+    struct fhi_request **p;
+    int state;
+
+    CpuSuspendIntr(&state);
+    for (p = list; *p != NULL && (*p)->priority >= req->priority; p = &(*p)->next)
+        ;
+    req->next = *p;
+    *p = req;
+    CpuResumeIntr(state);
+}
+
+//---------------------------------------------------------------------------
+int fhi_list_remove(struct fhi_request **list, struct fhi_request *req)
+{
+    struct fhi_request **p;
+    int state, rv = 0;
+
+    CpuSuspendIntr(&state);
+    for (p = list; *p != NULL; p = &(*p)->next) {
+        if (*p == req) {
+            *p = req->next;
+            rv = 1;
+            break;
+        }
+    }
+    CpuResumeIntr(state);
+
+    return rv;
+}
+
+//---------------------------------------------------------------------------
+void fhi_complete(struct fhi_request *req, int result)
+{
+    req->result = result;
+    if (req->callback != NULL)
+        req->callback(req);
+    req->state = FHI_REQ_DONE;
+}
+
+//---------------------------------------------------------------------------
+static int fhi_submit(struct fhi_request *req, int write)
+{
+    if (req->file_handle)
+        M_DEBUG("%s(%d, 0x%x, %d, %d, %d)\n", write ? "fhi_write_async" : "fhi_read_async", req->file_handle, req->buffer, req->sector_start, req->sector_count, req->priority);
+
+    if (req->file_handle < 0 || req->file_handle >= FHI_MAX_FILES) {
+        req->result = -1;
+        req->state = FHI_REQ_DONE;
+        return -1;
+    }
+
+    req->write = write;
+    req->result = 0;
+    req->progress = 0;
+    req->state = FHI_REQ_QUEUED;
+    fhi_queue_add(req);
+
+    SignalSema(fhi_queue_sema);
+
+    return 0;
+}
+
+//---------------------------------------------------------------------------
+static void fhi_thread(void *arg)
+{
+    int busy;
+
+    while (1) {
+        WaitSema(fhi_queue_sema);
+
+        // Release the device after every request, so a waiting thread
+        // can get its request serviced in between.
+        do {
+            WaitSema(fhi_io_sema);
+            busy = fhi_dispatch(NULL);
+            SignalSema(fhi_io_sema);
+        } while (busy);
+    }
+}
+
+//---------------------------------------------------------------------------
+// Synchronous request, serviced in the context of the caller
+static int fhi_sync(int file_handle, void *buffer, unsigned int sector_start, unsigned int sector_count, int write)
+{
+    struct fhi_request req;
+
+    req.file_handle = file_handle;
+    req.buffer = buffer;
+    req.sector_start = sector_start;
+    req.sector_count = sector_count;
+    req.priority = FHI_PRIO_HIGH;
+    req.callback = NULL;
+    req.arg = NULL;
+
+    if (fhi_submit(&req, write) < 0)
+        return -1;
+
+    return fhi_wait(&req);
+}
+
+//---------------------------------------------------------------------------
+// FHI export #5
+int fhi_read(int file_handle, void *buffer, unsigned int sector_start, unsigned int sector_count)
+{
+    return fhi_sync(file_handle, buffer, sector_start, sector_count, 0);
+}
+
+//---------------------------------------------------------------------------
+// FHI export #6
+int fhi_write(int file_handle, const void *buffer, unsigned int sector_start, unsigned int sector_count)
+{
+    return fhi_sync(file_handle, (void *)buffer, sector_start, sector_count, 1);
+}
+
+//---------------------------------------------------------------------------
+// FHI export #7
+int fhi_read_async(struct fhi_request *req)
+{
+    return fhi_submit(req, 0);
+}
+
+//---------------------------------------------------------------------------
+// FHI export #8
+int fhi_write_async(struct fhi_request *req)
+{
+    return fhi_submit(req, 1);
+}
+
+//---------------------------------------------------------------------------
+// FHI export #9
+int fhi_poll(struct fhi_request *req)
+{
+    return req->state == FHI_REQ_DONE;
+}
+
+//---------------------------------------------------------------------------
+// FHI export #10
+int fhi_wait(struct fhi_request *req)
+{
+    // Don't wait for the FHI thread, help servicing the queue instead
+    while (req->state != FHI_REQ_DONE) {
+        WaitSema(fhi_io_sema);
+        if (req->state != FHI_REQ_DONE)
+            fhi_dispatch(req);
+        SignalSema(fhi_io_sema);
+    }
+
+    return req->result;
+}
+
+//---------------------------------------------------------------------------
+void fhi_queue_init(int io_sema)
+{
+    iop_sema_t smp;
+    iop_thread_t ThreadData;
+    int th;
+
+    fhi_io_sema = io_sema;
+
+    // Create request queue semaphore, counts queued requests
+    smp.initial = 0;
+    smp.max = 0x7fffffff;
+    smp.option = 0;
+    smp.attr = SA_THPRI;
+    fhi_queue_sema = CreateSema(&smp);
+
+    ThreadData.attr = TH_C;
+    ThreadData.thread = (void *)fhi_thread;
+    ThreadData.option = 0;
+    ThreadData.priority = 10;
+    ThreadData.stacksize = 0x1000;
+    th = CreateThread(&ThreadData);
+    StartThread(th, 0);
+}
@@ -0,0 +1,31 @@
+// FHI request queue
+// Shared by the FHI modules, implements FHI exports #5 - #10.
+// How requests are queued and serviced is up to the module, through
+// fhi_queue_add and fhi_dispatch.
+#ifndef FHI_QUEUE_H
+#define FHI_QUEUE_H
+
+#include "fhi.h"
+
+// Create the FHI thread. io_sema locks the device: requests are only
+// serviced, and completed, while holding it.
+void fhi_queue_init(int io_sema);
+
+// Insert a request into a list, after all requests of the same or higher priority
+void fhi_list_insert(struct fhi_request **list, struct fhi_request *req);
+// Remove a request from a list, returns 1 if it was in the list
+int fhi_list_remove(struct fhi_request **list, struct fhi_request *req);
+// Complete a request, caller must hold the device lock
+void fhi_complete(struct fhi_request *req, int result);
+
+/*
+ * Provided by the module
+ */
+// Queue a submitted request
+void fhi_queue_add(struct fhi_request *req);
+// Service the next request, or the next part of it. Caller must hold the
+// device lock. wait_req is the request the caller waits for, or NULL when
+// called from the FHI thread. Returns 0 if there was nothing to do.
+int fhi_dispatch(struct fhi_request *wait_req);
+
+#endif // FHI_QUEUE_H
@@ -1,3 +1,4 @@
+#include <intrman.h>
 #include <loadcore.h>
 #include <stdio.h>
 #include <sysclib.h>
@@ -6,6 +7,7 @@
 #include <bdm.h>
 
 #include "fhi_bd.h"
+#include "fhi_queue.h"
 #include "mprintf.h"
 
 #define MODNAME "fhi" // give all fhi modules the same name
@@ -18,6 +20,8 @@ static int bdm_io_sema;
 extern struct irx_export_table _exp_bdm;
 extern struct irx_export_table _exp_fhi;
 
+static struct fhi_request *fhi_queue = NULL;
+
 //---------------------------------------------------------------------------
 // BDM export #4
 void bdm_connect_bd(struct block_device *bd)
@@ -69,41 +73,46 @@ u32 fhi_size(int file_handle)
 }
 
 //---------------------------------------------------------------------------
-// FHI export #5
-int fhi_read(int file_handle, void *buffer, unsigned int sector_start, unsigned int sector_count)
+// Execute a request, caller must hold bdm_io_sema
+static int fhi_run(struct fhi_request *req)
 {
-    int rv;
-
-    if (file_handle)
-        M_DEBUG("%s(%d, 0x%x, %d, %d)\n", __func__, file_handle, buffer, sector_start, sector_count);
-
-    if (file_handle < 0 || file_handle >= FHI_MAX_FILES)
-        return -1;
-
-    WaitSema(bdm_io_sema);
-    rv = g_bd->read(g_bd, sector_start, buffer, sector_count);
-    SignalSema(bdm_io_sema);
-
-    return rv;
+    if (req->write)
+        return g_bd->write(g_bd, req->sector_start, req->buffer, req->sector_count);
+    else
+        return g_bd->read(g_bd, req->sector_start, req->buffer, req->sector_count);
 }
 
 //---------------------------------------------------------------------------
-// FHI export #6
-int fhi_write(int file_handle, const void *buffer, unsigned int sector_start, unsigned int sector_count)
+void fhi_queue_add(struct fhi_request *req)
 {
-    int rv;
-
-    if (file_handle)
-        M_DEBUG("%s(%d, 0x%x, %d, %d)\n", __func__, file_handle, buffer, sector_start, sector_count);
+    fhi_list_insert(&fhi_queue, req);
+}
 
-    if (file_handle < 0 || file_handle >= FHI_MAX_FILES)
-        return -1;
+//---------------------------------------------------------------------------
+// Run the request that is waited for, or the first queued request
+int fhi_dispatch(struct fhi_request *wait_req)
+{
+    struct fhi_request *req;
+    int state;
+
+    if (wait_req != NULL) {
+        if (!fhi_list_remove(&fhi_queue, wait_req))
+            return 0;
+        req = wait_req;
+    } else {
+        CpuSuspendIntr(&state);
+        req = fhi_queue;
+        if (req != NULL)
+            fhi_queue = req->next;
+        CpuResumeIntr(state);
+        if (req == NULL)
+            return 0;
+    }
 
-    WaitSema(bdm_io_sema);
-    rv = g_bd->write(g_bd, sector_start, buffer, sector_count);
-    SignalSema(bdm_io_sema);
+    req->state = FHI_REQ_BUSY;
+    fhi_complete(req, fhi_run(req));
 
-    return rv;
+    return 1;
 }
 
 //---------------------------------------------------------------------------
@@ -145,6 +154,8 @@ int _start(int argc, char **argv)
     smp.attr = SA_THPRI;
     bdm_io_sema = CreateSema(&smp);
 
+    fhi_queue_init(bdm_io_sema);
+
     RegisterLibraryEntries(&_exp_bdm);
     RegisterLibraryEntries(&_exp_fhi);
 
@@ -3,6 +3,7 @@
 
 #include "irx.h"
 
+#include "intrman.h"
 #include "loadcore.h"
 #include "stdio.h"
 #include "sysclib.h"
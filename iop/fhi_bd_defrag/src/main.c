@@ -1,12 +1,13 @@
+#include <intrman.h>
 #include <loadcore.h>
 #include <stdio.h>
 #include <sysclib.h>
 #include <thsemap.h>
 #include <thbase.h>
 #include <bdm.h>
-#include <bd_defrag.h>
 
 #include "fhi_bd_defrag.h"
+#include "fhi_queue.h"
 #include "mprintf.h"
 
 #define MODNAME "fhi" // give all fhi modules the same name
@@ -19,6 +20,14 @@ static int bdm_io_sema;
 extern struct irx_export_table _exp_bdm;
 extern struct irx_export_table _exp_fhi;
 
+// Request queue per file
+static struct fhi_request *fhi_queue[FHI_MAX_FILES];
+
+// Scheduler state, protected by bdm_io_sema
+static u64 fhi_head;           // Device sector following the last transfer
+static int fhi_last_fid = -1;  // File of the last write
+static u32 fhi_last_end;       // File sector following the last write
+
 //---------------------------------------------------------------------------
 // BDM export #4
 void bdm_connect_bd(struct block_device *bd)
@@ -70,45 +79,219 @@ u32 fhi_size(int file_handle)
 }
 
 //---------------------------------------------------------------------------
-// FHI export #5
-int fhi_read(int file_handle, void *buffer, unsigned int sector_start, unsigned int sector_count)
+// Find the extent containing a file sector, using binary search
+static struct fhi_bd_defrag_extent *fhi_extent_find(struct fhi_bd_defrag_info *ff, u32 sector)
 {
-    int rv;
-    struct fhi_bd_defrag_info *ff;
+    struct fhi_bd_defrag_extent *ext = &fhi.extents[ff->ext_start];
+    unsigned int lo = 0;
+    unsigned int hi = ff->ext_count;
 
-    if (file_handle)
-        M_DEBUG("%s(%d, 0x%x, %d, %d)\n", __func__, file_handle, buffer, sector_start, sector_count);
+    // Find the first extent ending after the sector
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+        if (ext[mid].end > sector)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
 
-    if (file_handle < 0 || file_handle >= FHI_MAX_FILES)
-        return -1;
+    return (lo < ff->ext_count) ? &ext[lo] : NULL;
+}
 
-    ff = &fhi.file[file_handle];
-    WaitSema(bdm_io_sema);
-    rv = bd_defrag_read(g_bd, ff->frag_count, &fhi.frags[ff->frag_start],sector_start, buffer, sector_count);
-    SignalSema(bdm_io_sema);
+//---------------------------------------------------------------------------
+// Device sector of a file sector
+static u64 fhi_dev_sector(struct fhi_bd_defrag_info *ff, struct fhi_bd_defrag_extent *ext, u32 sector)
+{
+    u32 ext_first = (ext == &fhi.extents[ff->ext_start]) ? 0 : ext[-1].end;
 
-    return rv;
+    return ff->sector_base + ext->sector + (sector - ext_first);
 }
 
 //---------------------------------------------------------------------------
-// FHI export #6
-int fhi_write(int file_handle, const void *buffer, unsigned int sector_start, unsigned int sector_count)
+// Transfer sectors of a file, caller must hold bdm_io_sema
+static int fhi_transfer(struct fhi_bd_defrag_info *ff, int write, u32 sector, u8 *buffer, u32 count)
 {
-    int rv;
+    struct fhi_bd_defrag_extent *ext;
+    struct fhi_bd_defrag_extent *ext_end = &fhi.extents[ff->ext_start + ff->ext_count];
+
+    ext = fhi_extent_find(ff, sector);
+    while (count > 0) {
+        u32 n;
+        int rv;
+
+        // Transfer past the end of the file
+        if (ext == NULL || ext >= ext_end)
+            return -1;
+
+        n = ext->end - sector;
+        if (n > count)
+            n = count;
+
+        fhi_head = fhi_dev_sector(ff, ext, sector);
+        if (write)
+            rv = g_bd->write(g_bd, fhi_head, buffer, n);
+        else
+            rv = g_bd->read(g_bd, fhi_head, buffer, n);
+        if (rv != n)
+            return -1;
+        fhi_head += n;
+
+        buffer += n * 512;
+        sector += n;
+        count -= n;
+        ext++;
+    }
+
+    return 0;
+}
+
+//---------------------------------------------------------------------------
+// Scheduling key of a request, the request with the highest key is serviced
+// first. Caller must hold bdm_io_sema.
+static u32 fhi_sched_key(struct fhi_request *req, u64 *lba)
+{
+    struct fhi_bd_defrag_info *ff = &fhi.file[req->file_handle];
+    struct fhi_bd_defrag_extent *ext;
+    u32 sector = req->sector_start + req->progress;
+    int prio = req->priority - FHI_PRIO_LOW;
+    u32 key;
+
+    // CDVD reads are latency critical, don't let MC/ATA writes delay them
+    key = ((fhi.sched_flags & FHI_SCHED_CDVD_FIRST) && req->file_handle == FHI_FID_CDVD) ? 1 : 0;
+
+    // Then the priority of the request
+    key = (key << 2) | (prio < 0 ? 0 : (prio > 3 ? 3 : prio));
+
+    // Then continuing the last write, so adjacent writes go out back to back
+    key <<= 1;
+    if ((fhi.sched_flags & FHI_SCHED_COALESCE) && req->write && req->file_handle == fhi_last_fid && sector == fhi_last_end)
+        key |= 1;
+
+    // Then sectors ahead of the current head position (elevator)
+    key <<= 1;
+    *lba = 0;
+    if (fhi.sched_flags & FHI_SCHED_ELEVATOR) {
+        ext = fhi_extent_find(ff, sector);
+        if (ext != NULL)
+            *lba = fhi_dev_sector(ff, ext, sector);
+        if (*lba >= fhi_head)
+            key |= 1;
+    }
+
+    return key;
+}
+
+//---------------------------------------------------------------------------
+// Pick the next request to service, caller must hold bdm_io_sema
+static struct fhi_request *fhi_pick(void)
+{
+    struct fhi_request *req, *best = NULL;
+    u32 key, best_key = 0;
+    u64 lba, best_lba = 0;
+    int fid, state;
+
+    CpuSuspendIntr(&state);
+    for (fid = 0; fid < FHI_MAX_FILES; fid++) {
+        for (req = fhi_queue[fid]; req != NULL; req = req->next) {
+            key = fhi_sched_key(req, &lba);
+            // Equal keys: lowest sector first, FIFO without elevator
+            if (best == NULL || key > best_key || (key == best_key && lba < best_lba)) {
+                best = req;
+                best_key = key;
+                best_lba = lba;
+            }
+        }
+    }
+    CpuResumeIntr(state);
+
+    return best;
+}
+
+//---------------------------------------------------------------------------
+void fhi_queue_add(struct fhi_request *req)
+{
+    fhi_list_insert(&fhi_queue[req->file_handle], req);
+}
+
+//---------------------------------------------------------------------------
+// Find and take a queued write of at most max sectors, continuing at sector and buffer
+static struct fhi_request *fhi_take_adjacent_write(int fid, u32 sector, u8 *buffer, u32 max)
+{
+    struct fhi_request *req;
+    int state;
+
+    CpuSuspendIntr(&state);
+    for (req = fhi_queue[fid]; req != NULL; req = req->next) {
+        if (req->write && req->progress == 0 && req->sector_start == sector && req->buffer == buffer && req->sector_count <= max)
+            break;
+    }
+    CpuResumeIntr(state);
+
+    if (req != NULL) {
+        fhi_list_remove(&fhi_queue[fid], req);
+        req->state = FHI_REQ_BUSY;
+    }
+
+    return req;
+}
+
+//---------------------------------------------------------------------------
+// Service the next request, or the next chunk of a large write. The scheduler
+// picks the request, also for a waiting thread. Caller must hold bdm_io_sema.
+int fhi_dispatch(struct fhi_request *wait_req)
+{
+    struct fhi_request *req, *merged = NULL, **merged_tail = &merged;
     struct fhi_bd_defrag_info *ff;
+    u32 sector, count;
+    u8 *buffer;
+    int rv;
 
-    if (file_handle)
-        M_DEBUG("%s(%d, 0x%x, %d, %d)\n", __func__, file_handle, buffer, sector_start, sector_count);
+    req = fhi_pick();
+    if (req == NULL)
+        return 0;
 
-    if (file_handle < 0 || file_handle >= FHI_MAX_FILES)
-        return -1;
+    ff = &fhi.file[req->file_handle];
+    sector = req->sector_start + req->progress;
+    buffer = (u8 *)req->buffer + req->progress * 512;
+    count = req->sector_count - req->progress;
 
-    ff = &fhi.file[file_handle];
-    WaitSema(bdm_io_sema);
-    rv = bd_defrag_write(g_bd, ff->frag_count, &fhi.frags[ff->frag_start],sector_start, buffer, sector_count);
-    SignalSema(bdm_io_sema);
+    if (req->write) {
+        if (fhi.write_chunk != 0 && count > fhi.write_chunk) {
+            // Split large writes, so other requests can be serviced in between
+            count = fhi.write_chunk;
+        } else if (fhi.sched_flags & FHI_SCHED_COALESCE) {
+            // Merge queued writes continuing this one, in the file and in memory
+            u32 max = (fhi.write_chunk != 0) ? fhi.write_chunk : 0xffffffff;
+            struct fhi_request *next;
+            while ((next = fhi_take_adjacent_write(req->file_handle, sector + count, buffer + count * 512, max - count)) != NULL) {
+                count += next->sector_count;
+                next->next = NULL;
+                *merged_tail = next;
+                merged_tail = &next->next;
+            }
+        }
+    }
+
+    rv = fhi_transfer(ff, req->write, sector, buffer, count);
+    if (req->write) {
+        fhi_last_fid = req->file_handle;
+        fhi_last_end = sector + count;
+    }
+
+    while (merged != NULL) {
+        struct fhi_request *next = merged->next;
+        fhi_complete(merged, (rv < 0) ? -1 : (int)merged->sector_count);
+        merged = next;
+    }
+
+    if (rv < 0 || (req->progress + count) >= req->sector_count) {
+        fhi_list_remove(&fhi_queue[req->file_handle], req);
+        fhi_complete(req, (rv < 0) ? -1 : (int)req->sector_count);
+    } else {
+        req->progress += count;
+    }
 
-    return rv;
+    return 1;
 }
 
 //---------------------------------------------------------------------------
@@ -150,6 +333,8 @@ int _start(int argc, char **argv)
     smp.attr = SA_THPRI;
     bdm_io_sema = CreateSema(&smp);
 
+    fhi_queue_init(bdm_io_sema);
+
     RegisterLibraryEntries(&_exp_bdm);
     RegisterLibraryEntries(&_exp_fhi);
 
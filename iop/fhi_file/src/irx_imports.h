@@ -4,6 +4,7 @@
 #include "irx.h"
 
 #include "ioman.h"
+#include "intrman.h"
 #include "loadcore.h"
 #include "stdio.h"
 #include "sysclib.h"
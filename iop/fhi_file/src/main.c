@@ -1,4 +1,5 @@
 #include <ioman.h>
+#include <intrman.h>
 #include <loadcore.h>
 #include <stdio.h>
 #include <sysclib.h>
@@ -6,6 +7,7 @@
 #include <thbase.h>
 
 #include "fhi_file.h"
+#include "fhi_queue.h"
 #include "mprintf.h"
 
 #define MODNAME "fhi" // give all fhi modules the same name
@@ -15,6 +17,14 @@ struct fhi_file fhi = {MODULE_SETTINGS_MAGIC};
 
 extern struct irx_export_table _exp_fhi;
 
+static struct fhi_request *fhi_queue = NULL;
+static int fhi_io_sema;
+
+// Files are kept open, together with the sector at their file position
+#define FHI_POS_UNKNOWN 0xffffffff
+static int fhi_fd[FHI_MAX_FILES] = {-1, -1, -1, -1, -1, -1};
+static u32 fhi_pos[FHI_MAX_FILES];
+
 //---------------------------------------------------------------------------
 // FHI export #4
 u32 fhi_size(int file_handle)
@@ -28,50 +38,98 @@ u32 fhi_size(int file_handle)
 }
 
 //---------------------------------------------------------------------------
-// FHI export #5
-int fhi_read(int file_handle, void *buffer, unsigned int sector_start, unsigned int sector_count)
+// Get the file descriptor of a file, opening it on first use
+static int fhi_get_fd(int file_handle)
 {
-    int rv = 0;
-    struct fhi_file_info *ff;
-
-    if (file_handle)
-        M_DEBUG("%s(%d, 0x%x, %d, %d)\n", __func__, file_handle, buffer, sector_start, sector_count);
+    struct fhi_file_info *ff = &fhi.file[file_handle];
+    int fd = fhi_fd[file_handle];
 
-    if (file_handle < 0 || file_handle >= FHI_MAX_FILES)
-        return -1;
+    if (fd >= 0 || ff->name[0] == '\0')
+        return fd;
 
-    ff = &fhi.file[file_handle];
+    // Read-only media can still be used for reading
+    fd = open(ff->name, FIO_O_RDWR);
+    if (fd < 0)
+        fd = open(ff->name, FIO_O_RDONLY);
+    M_DEBUG("%s(%d) %s = %d\n", __func__, file_handle, ff->name, fd);
 
-    // Make nicer!
-    int fd = open(ff->name, FIO_O_RDONLY);
-    if (fd > 0) {
-        lseek(fd, sector_start * 512, FIO_SEEK_SET);
-        if (read(fd, buffer, sector_count * 512) == sector_count * 512)
-            rv = sector_count;
-        close(fd);
-    }
+    fhi_fd[file_handle] = fd;
+    fhi_pos[file_handle] = 0;
 
-    return rv;
+    return fd;
 }
 
 //---------------------------------------------------------------------------
-// FHI export #6
-int fhi_write(int file_handle, const void *buffer, unsigned int sector_start, unsigned int sector_count)
+// Execute a request, caller must hold fhi_io_sema.
+// Returns the number of sectors transferred, or -1 on error.
+static int fhi_run(struct fhi_request *req)
 {
-    int rv;
-    //struct fhi_file_info *ff;
+    int fd, rv;
+    int fid = req->file_handle;
 
-    if (file_handle)
-        M_DEBUG("%s(%d, 0x%x, %d, %d)\n", __func__, file_handle, buffer, sector_start, sector_count);
+    fd = fhi_get_fd(fid);
+    if (fd < 0)
+        return -1;
 
-    if (file_handle < 0 || file_handle >= FHI_MAX_FILES)
+    // Only seek when not continuing where the last transfer ended
+    if (fhi_pos[fid] != req->sector_start) {
+        if (lseek(fd, req->sector_start * 512, FIO_SEEK_SET) < 0) {
+            fhi_pos[fid] = FHI_POS_UNKNOWN;
+            return -1;
+        }
+        fhi_pos[fid] = req->sector_start;
+    }
+
+    if (req->write)
+        rv = write(fd, req->buffer, req->sector_count * 512);
+    else
+        rv = read(fd, req->buffer, req->sector_count * 512);
+
+    if (rv < 0) {
+        fhi_pos[fid] = FHI_POS_UNKNOWN;
         return -1;
+    }
 
-    //ff = &fhi.file[file_handle];
+    // A partial transfer can leave the file position inside a sector
+    if (rv & 511)
+        fhi_pos[fid] = FHI_POS_UNKNOWN;
+    else
+        fhi_pos[fid] += rv / 512;
 
-    // TODO!
+    return rv / 512;
+}
+
+//---------------------------------------------------------------------------
+void fhi_queue_add(struct fhi_request *req)
+{
+    fhi_list_insert(&fhi_queue, req);
+}
+
+//---------------------------------------------------------------------------
+// Run the request that is waited for, or the first queued request
+int fhi_dispatch(struct fhi_request *wait_req)
+{
+    struct fhi_request *req;
+    int state;
+
+    if (wait_req != NULL) {
+        if (!fhi_list_remove(&fhi_queue, wait_req))
+            return 0;
+        req = wait_req;
+    } else {
+        CpuSuspendIntr(&state);
+        req = fhi_queue;
+        if (req != NULL)
+            fhi_queue = req->next;
+        CpuResumeIntr(state);
+        if (req == NULL)
+            return 0;
+    }
 
-    return rv;
+    req->state = FHI_REQ_BUSY;
+    fhi_complete(req, fhi_run(req));
+
+    return 1;
 }
 
 //---------------------------------------------------------------------------
@@ -88,6 +146,7 @@ static void watchdog_thread()
 //---------------------------------------------------------------------------
 int _start(int argc, char **argv)
 {
+    iop_sema_t smp;
 #ifdef DEBUG
     int th;
     iop_thread_t ThreadData;
@@ -105,6 +164,15 @@ int _start(int argc, char **argv)
     StartThread(th, 0);
 #endif
 
+    // Create file access semaphore
+    smp.initial = 1;
+    smp.max = 1;
+    smp.option = 0;
+    smp.attr = SA_THPRI;
+    fhi_io_sema = CreateSema(&smp);
+
+    fhi_queue_init(fhi_io_sema);
+
     RegisterLibraryEntries(&_exp_fhi);
 
     return MODULE_RESIDENT_END;
@@ -8,6 +8,7 @@
 #include "main.h"
 #include "xfer.h"
 #include "ministack.h"
+#include "udpbd.h"
 
 // Last SDK 3.1.0 has INET family version "2.26.0"
 // SMAP module is the same as "2.25.0"
@@ -65,6 +66,13 @@ int _start(int argc, char *argv[])
             if (ip != 0)
                 ms_ip_set_ip(ip);
         }
+#ifndef NO_BDM
+        else if (!strncmp(argv[i], "server=", 7)) {
+            uint32_t ip = parse_ip(&argv[i][7]);
+            if (ip != 0)
+                udpbd_set_server_ip(ip);
+        }
+#endif
     }
 
     return MODULE_RESIDENT_END;
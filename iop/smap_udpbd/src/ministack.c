@@ -31,7 +31,11 @@ void ip_packet_init(ip_packet_t *pkt, uint32_t ip_dest)
 {
     eth_packet_init((eth_packet_t *)pkt, ETH_TYPE_IPV4);
 
-    // IP, broadcast
+    // Ethernet, unicast if the MAC address is known
+    if (ip_dest != IP_ADDR(255, 255, 255, 255))
+        arp_get_entry(ip_dest, pkt->eth.addr_dst);
+
+    // IP
     pkt->ip.hlen             = 0x45;
     pkt->ip.tos              = 0;
     //pkt->ip_len              = ;
@@ -116,33 +120,76 @@ int udp_packet_send_ll(udp_socket_t *socket, udp_packet_t *pkt, uint16_t pktdata
     return ip_packet_send_ll((ip_packet_t *)pkt, sizeof(udp_header_t) + pktdatasize, data, datasize);
 }
 
-int arp_add_entry(uint32_t ip, uint8_t mac[6])
+static void arp_set_entry(int i, uint32_t ip, uint8_t mac[6])
+{
+    arp_table[i].ip  = ip;
+    arp_table[i].mac[0] = mac[0];
+    arp_table[i].mac[1] = mac[1];
+    arp_table[i].mac[2] = mac[2];
+    arp_table[i].mac[3] = mac[3];
+    arp_table[i].mac[4] = mac[4];
+    arp_table[i].mac[5] = mac[5];
+}
+
+int arp_update_entry(uint32_t ip, uint8_t mac[6])
 {
     int i;
 
-    // Update existing entry
+    if (ip == 0)
+        return -1;
+
     for (i=0; i<MS_ARP_ENTRIES; i++) {
         if (ip == arp_table[i].ip) {
-            arp_table[i].mac[0] = mac[0];
-            arp_table[i].mac[1] = mac[1];
-            arp_table[i].mac[2] = mac[2];
-            arp_table[i].mac[3] = mac[3];
-            arp_table[i].mac[4] = mac[4];
-            arp_table[i].mac[5] = mac[5];
+            arp_set_entry(i, ip, mac);
             return 0;
         }
     }
 
+    return -1;
+}
+
+int arp_add_entry(uint32_t ip, uint8_t mac[6])
+{
+    static int arp_next = 0;
+    int i;
+
+    if (ip == 0)
+        return -1;
+
+    // Update existing entry
+    if (arp_update_entry(ip, mac) == 0)
+        return 0;
+
     // Add new entry
     for (i=0; i<MS_ARP_ENTRIES; i++) {
-        if (ip == 0) {
-            arp_table[i].ip  = ip;
-            arp_table[i].mac[0] = mac[0];
-            arp_table[i].mac[1] = mac[1];
-            arp_table[i].mac[2] = mac[2];
-            arp_table[i].mac[3] = mac[3];
-            arp_table[i].mac[4] = mac[4];
-            arp_table[i].mac[5] = mac[5];
+        if (arp_table[i].ip == 0) {
+            arp_set_entry(i, ip, mac);
+            return 0;
+        }
+    }
+
+    // Table full, replace the oldest entry
+    arp_set_entry(arp_next, ip, mac);
+    arp_next = (arp_next + 1) % MS_ARP_ENTRIES;
+
+    return 0;
+}
+
+int arp_get_entry(uint32_t ip, uint8_t mac[6])
+{
+    int i;
+
+    if (ip == 0)
+        return -1;
+
+    for (i=0; i<MS_ARP_ENTRIES; i++) {
+        if (ip == arp_table[i].ip) {
+            mac[0] = arp_table[i].mac[0];
+            mac[1] = arp_table[i].mac[1];
+            mac[2] = arp_table[i].mac[2];
+            mac[3] = arp_table[i].mac[3];
+            mac[4] = arp_table[i].mac[4];
+            mac[5] = arp_table[i].mac[5];
             return 0;
         }
     }
@@ -167,7 +214,14 @@ static inline int handle_rx_arp(uint16_t pointer)
     parp[ 9] = SMAP_REG32(SMAP_R_RXFIFO_DATA); // 26
     parp[10] = SMAP_REG32(SMAP_R_RXFIFO_DATA); // 30
 
-    if (ntohs(req.arp.oper) == 1 && ntohl(req.arp.target_ip) == ip_addr) {
+    if (ntohl(req.arp.target_ip) != ip_addr)
+        return -1;
+
+    // Keep the addresses of known hosts up to date. New hosts are not
+    // added, only the hosts we talk to (the UDPBD server) are.
+    arp_update_entry(ntohl(req.arp.sender_ip), req.arp.sender_mac);
+
+    if (ntohs(req.arp.oper) == 1) {
         reply.eth.addr_dst[0] = req.arp.sender_mac[0];
         reply.eth.addr_dst[1] = req.arp.sender_mac[1];
         reply.eth.addr_dst[2] = req.arp.sender_mac[2];
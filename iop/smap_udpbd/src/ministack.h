@@ -233,7 +233,31 @@ uint32_t ms_ip_get_ip();
 
 
 
+/**
+ * Add or update an entry in the ARP table
+ * When the table is full, the oldest entry is replaced
+ * @param ip IP addres
+ * @param mac MAC address
+ * @return 0 on succes, -1 for an invalid IP address
+ */
 int arp_add_entry(uint32_t ip, uint8_t mac[6]);
+
+/**
+ * Update an existing entry in the ARP table
+ * @param ip IP addres
+ * @param mac MAC address
+ * @return 0 on succes, -1 when not found
+ */
+int arp_update_entry(uint32_t ip, uint8_t mac[6]);
+
+/**
+ * Look up the MAC address of an IP address in the ARP table
+ * @param ip IP addres
+ * @param mac MAC address, only written when found
+ * @return 0 on succes, -1 when not found
+ */
+int arp_get_entry(uint32_t ip, uint8_t mac[6]);
+
 int handle_rx_eth(uint16_t pointer);
 
 
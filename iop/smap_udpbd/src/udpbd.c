@@ -2,6 +2,7 @@
 #include <bdm.h>
 #include <thevent.h>
 #include <stdio.h>
+#include <sysclib.h>
 #include <smapregs.h>
 #include <dmacman.h>
 #include <dev9.h>
@@ -13,6 +14,21 @@
 
 #define UDPBD_MAX_RETRIES         4
 
+// Timeouts, derived from the measured round trip time like TCP (RFC 6298)
+#define UDPBD_RTO_INIT            (200 * 1000)  // usec, until the first measurement
+#define UDPBD_RTO_MIN             (5 * 1000)    // usec
+#define UDPBD_RTO_MAX             (2000 * 1000) // usec
+#define UDPBD_READ_USEC_PER_SECTOR_INIT 2000    // Transfer time allowance until measured
+#define UDPBD_READ_USEC_PER_SECTOR_MIN  100     // Lowest transfer time allowance, 5MB/s
+#define UDPBD_READ_SAMPLE_MIN     64            // Sectors, smaller read commands are not measured
+#define UDPBD_WRITE_USEC_PER_SECTOR 2000
+#define UDPBD_WRITE_TIMEOUT_MIN   (200 * 1000)  // usec, writes include server disk time
+
+#define UDPBD_WRITE_WINDOW        4 // Write commands waiting for WRITE_DONE
+#define UDPBD_WRITE_CHUNK         8 // Sectors per write command (4KiB)
+#define UDPBD_WRITE_BLOCK_SHIFT   5 // 128 byte blocks
+#define UDPBD_WRITE_BLOCK_MAX     (RDMA_MAX_PAYLOAD >> (UDPBD_WRITE_BLOCK_SHIFT + 2)) // 11 blocks = 1408 bytes
+
 
 struct SUDPBDv2_Header_Padded32 {
     union
@@ -52,224 +68,550 @@ typedef struct
 } __attribute__((packed, aligned(4))) udpbd_pkt_rdma_t;
 
 
+#define UDPBD_READ_WINDOW         4  // Read commands in flight, 2..8
+// Sectors per read command (224KiB). The smallest full RDMA packet is 1024 bytes, with 512
+// or 1024 byte blocks, so a command takes at most 224 packets: cmdpkt (8 bits) can't wrap.
+#define UDPBD_READ_CHUNK          448
+
+// State of a read command
+#define UDPBD_RD_FREE             0
+#define UDPBD_RD_BUSY             1
+#define UDPBD_RD_DONE             2
+#define UDPBD_RD_ERROR            3
+#define UDPBD_RD_INCOMPLETE       4 // Last packet received, but packets are missing
+
+#define UDPBD_PKT_IRREGULAR       0xffffffff // Server does not fill every packet
+
+struct udpbd_rd
+{
+    uint8_t *buffer;        // Destination buffer
+    uint32_t size;          // Bytes to receive
+    uint32_t size_left;     // Bytes left to receive
+    uint32_t offset_next;   // Offset of the next packet in order
+    uint32_t pkt_size;      // Payload of a full RDMA packet, 0 if unknown
+    uint32_t pkt_map[8];    // Received packets, bit per cmdpkt. A full read command takes <= 224 packets
+    uint32_t sector;
+    uint16_t count;
+    uint8_t cmdpkt;         // Next packet in order
+    uint8_t retransmit;     // Don't measure the round trip time (Karn)
+    uint32_t sent_clk;      // Time the command was sent
+    uint32_t first_clk;     // Time the first packet arrived
+    volatile uint8_t state; // UDPBD_RD_*
+};
+
+// Write command, sent from the buffer of the caller: udpbd_write returns only when all are done
+struct udpbd_wr
+{
+    const uint8_t *data;
+    uint32_t sector;
+    uint16_t count;
+    uint8_t cmdid;
+    uint8_t retransmit;     // Sent more than once, so more than one WRITE_DONE can arrive
+    volatile uint8_t state; // UDPBD_RD_*
+};
+
 static struct block_device g_udpbd;
 static uint8_t g_cmdid   = 0;
 static int g_ev_done   = 0;
-static int g_read_cmdpkt = 0;
 static int bdm_connected = 0;
-static uint8_t *g_buffer = NULL;
-static uint8_t *g_buffer_act = NULL;
-static unsigned int g_read_size;
-static int32_t g_errno = 0;
+static struct udpbd_rd g_rd[8]; // Read commands, by cmdid
+static struct udpbd_wr g_wr[UDPBD_WRITE_WINDOW]; // Write commands, oldest first from g_wr_head
+static int g_wr_head = 0;
+static int g_wr_count = 0;
+static uint8_t g_wr_cmdids = 0; // cmdids used by write commands
+static uint8_t g_wr_retired = 0; // cmdids of retransmitted write commands, kept until late replies are gone
+static uint32_t g_wr_retired_clk[8]; // Time each retired cmdid was released
 static udp_socket_t *udpbd_socket = NULL;
+static uint32_t g_server_ip = IP_ADDR(255,255,255,255); // Broadcast until the server replies
+static int g_server_fixed = 0; // Server IP configured, don't accept others
+static struct udpbd_stats g_stats;
+static uint32_t g_last_done_clk; // Time the last read command completed
 
 
 static unsigned int _udpbd_timeout(void *arg)
 {
-    g_read_size = 0;
-    g_errno     = 1;
     iSetEventFlag(g_ev_done, 2);
     return 0;
 }
 
-//
-// Block device interface
-//
-static int _udpbd_read(struct block_device *bd, uint64_t sector, void *buffer, uint16_t count)
+static uint32_t _udpbd_clk2usec(uint32_t clk)
 {
-    uint32_t EFBits;
     iop_sys_clock_t clock;
-    udpbd_pkt_rw_t pkt;
+    uint32_t sec, usec;
 
-    //M_DEBUG("%s: sector=%d, count=%d\n", __func__, (uint32_t)sector, count);
+    clock.lo = clk;
+    clock.hi = 0;
+    SysClock2USec(&clock, &sec, &usec);
+
+    return (sec * 1000 * 1000) + usec;
+}
+
+static void _udpbd_rtt_sample(uint32_t rtt)
+{
+    uint32_t delta;
+
+    g_stats.rtt = rtt;
+    if (g_stats.srtt == 0) {
+        // First measurement
+        g_stats.srtt = rtt;
+        g_stats.rttvar = rtt / 2;
+    } else {
+        delta = (g_stats.srtt > rtt) ? (g_stats.srtt - rtt) : (rtt - g_stats.srtt);
+        g_stats.rttvar = (3 * g_stats.rttvar + delta) / 4;
+        g_stats.srtt = (7 * g_stats.srtt + rtt) / 8;
+    }
+
+    g_stats.rto = g_stats.srtt + 4 * g_stats.rttvar;
+    if (g_stats.rto < UDPBD_RTO_MIN)
+        g_stats.rto = UDPBD_RTO_MIN;
+    if (g_stats.rto > UDPBD_RTO_MAX)
+        g_stats.rto = UDPBD_RTO_MAX;
+}
 
-    g_cmdid         = (g_cmdid + 1) & 0x7;
-    g_buffer        = buffer;
-    g_buffer_act    = buffer;
-    g_read_size     = count * g_udpbd.sectorSize;
-    g_read_cmdpkt   = 1; // First reply packet should be cmdpkt==1
+// Measured transfer time of one sector, from the first to the last packet of a read command
+static void _udpbd_sector_sample(uint32_t usec)
+{
+    g_stats.sector_usec = (g_stats.sector_usec == 0) ? usec : ((7 * g_stats.sector_usec + usec) / 8);
+}
 
-    udp_packet_init((udp_packet_t *)&pkt, IP_ADDR(255,255,255,255), UDPBD_SERVER_PORT);
+// Time to allow for the transfer of a read command, after its first packet could arrive.
+// Twice the measured transfer time, so slow links (like a Wi-Fi bridge) don't time out.
+static uint32_t _udpbd_read_allowance(uint32_t count)
+{
+    uint32_t usec = (g_stats.sector_usec == 0) ? UDPBD_READ_USEC_PER_SECTOR_INIT : (2 * g_stats.sector_usec);
+
+    if (usec < UDPBD_READ_USEC_PER_SECTOR_MIN)
+        usec = UDPBD_READ_USEC_PER_SECTOR_MIN;
+
+    return count * usec;
+}
+
+static void _udpbd_rto_backoff(void)
+{
+    g_stats.timeouts++;
+    g_stats.rto *= 2;
+    if (g_stats.rto > UDPBD_RTO_MAX)
+        g_stats.rto = UDPBD_RTO_MAX;
+}
+
+// Get the next cmdid not used by a command in flight
+static uint8_t _udpbd_cmdid_next(void)
+{
+    uint32_t now = GetSystemTimeLow();
+    uint32_t hold = 4 * g_stats.rto;
+    int i;
+
+    // A late WRITE_DONE for a retired cmdid arrives within one write timeout
+    if (hold < UDPBD_WRITE_TIMEOUT_MIN)
+        hold = UDPBD_WRITE_TIMEOUT_MIN;
+    for (i = 0; i < 8; i++) {
+        if ((g_wr_retired & (1U << i)) && _udpbd_clk2usec(now - g_wr_retired_clk[i]) >= hold)
+            g_wr_retired &= ~(1U << i);
+    }
+
+    for (i = 1; i <= 8; i++) {
+        uint8_t cmdid = (g_cmdid + i) & 0x7;
+        if (g_rd[cmdid].state == UDPBD_RD_FREE && !((g_wr_cmdids | g_wr_retired) & (1U << cmdid)))
+            break;
+    }
+    if (i > 8 && g_wr_retired != 0) {
+        // Every free cmdid is still reserved, release the reservations
+        g_wr_retired = 0;
+        return _udpbd_cmdid_next();
+    }
+    g_cmdid = (g_cmdid + i) & 0x7;
+
+    return g_cmdid;
+}
+
+//
+// Block device interface
+//
+static int _udpbd_read_start(uint32_t sector, void *buffer, uint16_t count)
+{
+    udpbd_pkt_rw_t pkt;
+    uint8_t cmdid = _udpbd_cmdid_next();
+    struct udpbd_rd *rd = &g_rd[cmdid];
+
+    //M_DEBUG("%s: sector=%d, count=%d, cmdid=%d\n", __func__, sector, count, cmdid);
+
+    rd->buffer      = buffer;
+    rd->size        = count * g_udpbd.sectorSize;
+    rd->size_left   = rd->size;
+    rd->offset_next = 0;
+    rd->pkt_size    = 0;
+    memset(rd->pkt_map, 0, sizeof(rd->pkt_map));
+    rd->sector      = sector;
+    rd->count       = count;
+    rd->cmdpkt      = 1; // First reply packet should be cmdpkt==1
+    rd->retransmit  = 0;
+    rd->sent_clk    = GetSystemTimeLow();
+    rd->state       = UDPBD_RD_BUSY;
+
+    udp_packet_init((udp_packet_t *)&pkt, g_server_ip, UDPBD_SERVER_PORT);
     pkt.rw.hdr.cmd    = UDPBD_CMD_READ;
-    pkt.rw.hdr.cmdid  = g_cmdid;
+    pkt.rw.hdr.cmdid  = cmdid;
     pkt.rw.hdr.cmdpkt = 0;
     pkt.rw.sector_count = count;
     pkt.rw.sector_nr = sector;
 
-    if (udp_packet_send(udpbd_socket, (udp_packet_t *)&pkt, sizeof(struct SUDPBDv2_RWRequest)) < 0)
+    if (udp_packet_send(udpbd_socket, (udp_packet_t *)&pkt, sizeof(struct SUDPBDv2_RWRequest)) < 0) {
+        rd->state = UDPBD_RD_FREE;
         return -1;
+    }
+
+    return cmdid;
+}
+
+// Wait for a read command. The server handles commands in order: ahead is the
+// number of sectors it still has to send for commands sent before this one.
+static int _udpbd_read_wait(uint8_t cmdid, uint32_t ahead)
+{
+    uint32_t EFBits;
+    iop_sys_clock_t clock;
+    struct udpbd_rd *rd = &g_rd[cmdid];
+    int rv;
 
     // Set alarm in case something hangs
-    // 200ms + 2ms / sector
-    USec2SysClock((200 * 1000) + (count * 2000), &clock);
+    USec2SysClock(g_stats.rto + _udpbd_read_allowance(ahead + rd->count), &clock);
     SetAlarm(&clock, _udpbd_timeout, NULL);
 
-    //wait for data...
-    WaitEventFlag(g_ev_done, 2 | 1, WEF_OR | WEF_CLEAR, &EFBits);
+    // Other read commands finishing wake us up too
+    while (rd->state == UDPBD_RD_BUSY) {
+        WaitEventFlag(g_ev_done, 2 | 1, WEF_OR | WEF_CLEAR, &EFBits);
+        if (EFBits & 2)
+            break;
+    }
 
     // Cancel alarm
     CancelAlarm(_udpbd_timeout, NULL);
 
-    g_buffer      = NULL;
-    g_buffer_act  = NULL;
-    g_read_size   = 0;
-    g_read_cmdpkt = 0;
-
-    switch (g_errno)
+    switch (rd->state)
     {
-        case 0:
-            //M_DEBUG("%s(%d, %d): ok\n", __func__);
+        case UDPBD_RD_DONE:
+            rv = 0;
             break;
-        case 1:
-            M_DEBUG("%s(%d, %d): ERROR: timeout\n", __func__, (uint32_t)sector, count);
+        case UDPBD_RD_BUSY:
+            M_DEBUG("%s(%d, %d): ERROR: timeout\n", __func__, rd->sector, rd->count);
+            _udpbd_rto_backoff();
+            rv = -1;
+            break;
+        case UDPBD_RD_INCOMPLETE:
+            M_DEBUG("%s(%d, %d): ERROR: missing packets\n", __func__, rd->sector, rd->count);
+            rv = -1;
             break;
-        //case 2:
-        //    M_DEBUG("%s(%d, %d): ERROR: invalid packet order!\n", __func__, sector, count);
-        //    break;
-        //case 3:
-        //    M_DEBUG("%s(%d, %d): ERROR: invalid packet size!\n", __func__, sector, count);
-        //    break;
         default:
-            M_DEBUG("%s(%d, %d): ERROR: unknown %d\n", __func__, (uint32_t)sector, count, g_errno);
+            M_DEBUG("%s(%d, %d): ERROR: invalid packet\n", __func__, rd->sector, rd->count);
+            rv = -1;
             break;
     }
 
-    if (EFBits & 1)
-    { // done
-        return count;
-    }
+    // Late packets for this cmdid are dropped from now on
+    rd->state = UDPBD_RD_FREE;
 
-    g_errno = 0;
-    return -EIO;
+    return rv;
 }
 
-static int udpbd_read(struct block_device *bd, uint64_t sector, void *buffer, uint16_t count)
+static int _udpbd_read_retransmit(uint32_t sector, void *buffer, uint16_t count)
 {
-    int retries;
-    uint16_t count_left = count;
-
-    //M_DEBUG("%s: sector=%d, count=%d\n", __func__, (uint32_t)sector, count);
-
-    if (bdm_connected == 0)
-        return -EIO;
+    int cmdid = _udpbd_read_start(sector, buffer, count);
 
-    while (count_left > 0)
-    {
-        uint16_t count_block = count_left > UDPBD_MAX_SECTOR_READ ? UDPBD_MAX_SECTOR_READ : count_left;
+    if (cmdid >= 0)
+        g_rd[cmdid].retransmit = 1;
 
-        for (retries = 0; retries < UDPBD_MAX_RETRIES; retries++)
-        {
-            if (_udpbd_read(bd, sector, buffer, count_block) == count_block)
-                break;
-            DelayThread(1000);
-        }
+    return cmdid;
+}
 
-        if (retries == UDPBD_MAX_RETRIES)
-        {
-            M_DEBUG("%s: too many errors, disconnecting\n", __func__);
-            bdm_disconnect_bd(&g_udpbd);
-            bdm_connected = 0;
-            return -EIO;
+// Retransmit the part of a failed read command that did not arrive
+static int _udpbd_read_repair(uint8_t cmdid)
+{
+    struct udpbd_rd *rd = &g_rd[cmdid];
+    uint32_t first = rd->size;
+    uint32_t end = 0;
+    uint32_t offset;
+    int pkt;
+
+    g_stats.retransmits++;
+
+    // Nothing arrived, or unknown packet layout: read everything again
+    if (rd->pkt_size == 0 || rd->pkt_size == UDPBD_PKT_IRREGULAR)
+        return _udpbd_read_retransmit(rd->sector, rd->buffer, rd->count);
+
+    // Find the range of missing packets
+    for (pkt = 1, offset = 0; offset < rd->size; pkt++, offset += rd->pkt_size) {
+        if (!(rd->pkt_map[pkt / 32] & (1U << (pkt % 32)))) {
+            if (first == rd->size)
+                first = offset;
+            end = offset + rd->pkt_size;
         }
-
-        count_left -= count_block;
-        sector += count_block;
-        buffer += count_block * g_udpbd.sectorSize;
     }
+    if (end > rd->size)
+        end = rd->size;
 
-    return count;
+    // Read the sectors covering the missing range
+    first = first / g_udpbd.sectorSize;
+    end = (end + g_udpbd.sectorSize - 1) / g_udpbd.sectorSize;
+    M_DEBUG("%s(%d, %d): reading %d sectors at +%d\n", __func__, rd->sector, rd->count, end - first, first);
+
+    return _udpbd_read_retransmit(rd->sector + first, rd->buffer + first * g_udpbd.sectorSize, end - first);
 }
 
-static int udpbd_write(struct block_device *bd, uint64_t sector, const void *buffer, uint16_t count)
+static int _udpbd_write_send(struct udpbd_wr *wr)
 {
-    uint32_t EFBits;
-
-    M_DEBUG("%s: sector=%d, count=%d\n", __func__, (uint32_t)sector, count);
-
-    g_cmdid = (g_cmdid + 1) & 0x7;
-
     // Send write command
     {
         udpbd_pkt_rw_t pkt;
-        udp_packet_init((udp_packet_t *)&pkt, IP_ADDR(255,255,255,255), UDPBD_SERVER_PORT);
+
+        // A retransmission keeps its cmdid: a late WRITE_DONE for the first
+        // transmission must not complete another write command
+        if (wr->state == UDPBD_RD_FREE) {
+            wr->cmdid = _udpbd_cmdid_next();
+            wr->retransmit = 0;
+            g_wr_cmdids |= 1U << wr->cmdid;
+        } else
+            wr->retransmit = 1;
+        wr->state = UDPBD_RD_BUSY;
+
+        udp_packet_init((udp_packet_t *)&pkt, g_server_ip, UDPBD_SERVER_PORT);
         pkt.rw.hdr.cmd    = UDPBD_CMD_WRITE;
-        pkt.rw.hdr.cmdid  = g_cmdid;
+        pkt.rw.hdr.cmdid  = wr->cmdid;
         pkt.rw.hdr.cmdpkt = 0;
-        pkt.rw.sector_count = count;
-        pkt.rw.sector_nr = sector;
+        pkt.rw.sector_count = wr->count;
+        pkt.rw.sector_nr = wr->sector;
 
-        if (udp_packet_send(udpbd_socket, (udp_packet_t *)&pkt, sizeof(struct SUDPBDv2_RWRequest)) < 0) {
-            M_DEBUG("%s(%d, %d): ERROR\n", __func__, (uint32_t)sector, count);
+        if (udp_packet_send(udpbd_socket, (udp_packet_t *)&pkt, sizeof(struct SUDPBDv2_RWRequest)) < 0)
             return -1;
-        }
     }
 
-    // Send data
+    // Send data, filling every packet
     {
-        uint16_t count_left = count;
+        uint32_t size_left = wr->count * 512;
+        const uint8_t *data = wr->data;
         udpbd_pkt_rdma_t pkt;
-        udp_packet_init((udp_packet_t *)&pkt, IP_ADDR(255,255,255,255), UDPBD_SERVER_PORT);
+        udp_packet_init((udp_packet_t *)&pkt, g_server_ip, UDPBD_SERVER_PORT);
         pkt.hdr.cmd    = UDPBD_CMD_WRITE_RDMA;
-        pkt.hdr.cmdid  = g_cmdid;
+        pkt.hdr.cmdid  = wr->cmdid;
         pkt.hdr.cmdpkt = 0;
-        pkt.bt.block_count = 4; // 4 x 128b = 512b
-        pkt.bt.block_shift = 5; // 128 byte blocks
+        pkt.bt.block_shift = UDPBD_WRITE_BLOCK_SHIFT;
+
+        while (size_left > 0) {
+            uint32_t blocks = size_left >> (UDPBD_WRITE_BLOCK_SHIFT + 2);
+            uint32_t size;
+
+            if (blocks > UDPBD_WRITE_BLOCK_MAX)
+                blocks = UDPBD_WRITE_BLOCK_MAX;
+            size = blocks << (UDPBD_WRITE_BLOCK_SHIFT + 2);
 
-        while (count_left--) {
             pkt.hdr.cmdpkt++;
-            if (udp_packet_send_ll(udpbd_socket, (udp_packet_t *)&pkt, sizeof(struct SUDPBDv2_Header) + sizeof(union block_type), buffer, 512) < 0) {
-                M_DEBUG("%s(%d, %d): ERROR\n", __func__, (uint32_t)sector, count);
+            pkt.bt.block_count = blocks;
+            if (udp_packet_send_ll(udpbd_socket, (udp_packet_t *)&pkt, sizeof(struct SUDPBDv2_Header) + sizeof(union block_type), data, size) < 0)
                 return -1;
-            }
-            buffer = (const uint8_t *)buffer + 512;
+            data += size;
+            size_left -= size;
         }
     }
 
-    // Wait for 'done' from server
-    {
-        iop_sys_clock_t clock;
+    return 0;
+}
+
+// Wait for the oldest write command to be done
+static int _udpbd_write_wait(void)
+{
+    uint32_t EFBits;
+    iop_sys_clock_t clock;
+    struct udpbd_wr *wr = &g_wr[g_wr_head];
+    int retries, i;
 
+    for (retries = 0; retries < UDPBD_MAX_RETRIES; retries++) {
         // Set alarm in case something hangs
-        // 200ms
-        USec2SysClock((200 * 1000), &clock);
+        uint32_t timeout = 4 * g_stats.rto;
+        if (timeout < UDPBD_WRITE_TIMEOUT_MIN)
+            timeout = UDPBD_WRITE_TIMEOUT_MIN;
+        USec2SysClock(timeout + (wr->count * UDPBD_WRITE_USEC_PER_SECTOR), &clock);
         SetAlarm(&clock, _udpbd_timeout, NULL);
 
-        //wait for done...
-        WaitEventFlag(g_ev_done, 2 | 1, WEF_OR | WEF_CLEAR, &EFBits);
+        // Other write commands finishing wake us up too
+        while (wr->state == UDPBD_RD_BUSY) {
+            WaitEventFlag(g_ev_done, 2 | 1, WEF_OR | WEF_CLEAR, &EFBits);
+            if (EFBits & 2)
+                break;
+        }
 
         // Cancel alarm
         CancelAlarm(_udpbd_timeout, NULL);
+
+        if (wr->state == UDPBD_RD_DONE) {
+            wr->state = UDPBD_RD_FREE;
+            g_wr_cmdids &= ~(1U << wr->cmdid);
+            if (wr->retransmit) {
+                g_wr_retired |= 1U << wr->cmdid;
+                g_wr_retired_clk[wr->cmdid] = GetSystemTimeLow();
+            }
+            g_wr_head = (g_wr_head + 1) % UDPBD_WRITE_WINDOW;
+            g_wr_count--;
+            return 0;
+        }
+
+        if (wr->state == UDPBD_RD_BUSY) {
+            M_DEBUG("%s(%d, %d): ERROR: timeout\n", __func__, wr->sector, wr->count);
+            _udpbd_rto_backoff();
+        } else {
+            M_DEBUG("%s(%d, %d): ERROR\n", __func__, wr->sector, wr->count);
+        }
+
+        // The server writes in order, so send this and all later commands
+        // again. Later writes can overlap with this one.
+        g_stats.retransmits++;
+        DelayThread(1000);
+        for (i = 0; i < g_wr_count; i++) {
+            if (_udpbd_write_send(&g_wr[(g_wr_head + i) % UDPBD_WRITE_WINDOW]) < 0)
+                break;
+        }
     }
 
-    switch (g_errno)
-    {
-        case 0:
-            //M_DEBUG("%s(%d, %d): ok\n", __func__);
-            break;
-        case 1:
-            M_DEBUG("%s(%d, %d): ERROR: timeout\n", __func__, (uint32_t)sector, count);
-            break;
-        case 2:
-            //M_DEBUG("%s(%d, %d): ERROR: invalid packet order!\n", __func__, sector, count);
-            break;
-        case 3:
-            //M_DEBUG("%s(%d, %d): ERROR: invalid packet size!\n", __func__, sector, count);
-            break;
-        default:
-            M_DEBUG("%s(%d, %d): ERROR: unknown %d\n", __func__, (uint32_t)sector, count, g_errno);
-            break;
+    return -1;
+}
+
+// Drop all write commands after an unrecoverable error
+static int _udpbd_write_fail(void)
+{
+    int i;
+
+    M_DEBUG("%s: too many errors, disconnecting\n", __func__);
+
+    for (i = 0; i < UDPBD_WRITE_WINDOW; i++)
+        g_wr[i].state = UDPBD_RD_FREE;
+    g_wr_head = 0;
+    g_wr_count = 0;
+    g_wr_cmdids = 0;
+    g_wr_retired = 0;
+    bdm_disconnect_bd(&g_udpbd);
+    bdm_connected = 0;
+    return -EIO;
+}
+
+// Wait for all write commands to be done
+static int _udpbd_write_flush(void)
+{
+    while (g_wr_count > 0) {
+        if (_udpbd_write_wait() < 0)
+            return _udpbd_write_fail();
     }
 
-    if (EFBits & 1)
-    { // done
-        return count;
+    return 0;
+}
+
+static int udpbd_read(struct block_device *bd, uint64_t sector, void *buffer, uint16_t count)
+{
+    uint8_t window[UDPBD_READ_WINDOW]; // cmdids in flight, oldest first
+    int head = 0;
+    int inflight = 0;
+    int retries = 0;
+    int cmdid, i;
+    uint32_t ahead;
+    uint16_t count_sent = 0;
+
+    //M_DEBUG("%s: sector=%d, count=%d\n", __func__, (uint32_t)sector, count);
+
+    if (bdm_connected == 0)
+        return -EIO;
+
+    while (count_sent < count || inflight > 0)
+    {
+        // Keep the window filled, so the server always has the next command
+        while (inflight < UDPBD_READ_WINDOW && count_sent < count)
+        {
+            uint16_t count_block = (count - count_sent) > UDPBD_READ_CHUNK ? UDPBD_READ_CHUNK : (count - count_sent);
+
+            cmdid = _udpbd_read_start(sector + count_sent, (uint8_t *)buffer + count_sent * g_udpbd.sectorSize, count_block);
+            if (cmdid < 0)
+                goto error;
+            window[(head + inflight) % UDPBD_READ_WINDOW] = cmdid;
+            inflight++;
+            count_sent += count_block;
+        }
+
+        // Wait for the oldest command, the others keep arriving meanwhile.
+        // A repair is sent after the other commands in flight, so the server sends those first.
+        cmdid = window[head];
+        ahead = 0;
+        if (retries > 0) {
+            for (i = 1; i < inflight; i++) {
+                struct udpbd_rd *rd = &g_rd[window[(head + i) % UDPBD_READ_WINDOW]];
+                if (rd->state == UDPBD_RD_BUSY)
+                    ahead += rd->size_left / g_udpbd.sectorSize;
+            }
+        }
+        if (_udpbd_read_wait(cmdid, ahead) == 0)
+        {
+            head = (head + 1) % UDPBD_READ_WINDOW;
+            inflight--;
+            retries = 0;
+            continue;
+        }
+
+        // Retry only what is missing of the failed command
+        if (++retries >= UDPBD_MAX_RETRIES)
+            goto error;
+        if (g_rd[cmdid].pkt_size == 0 || g_rd[cmdid].pkt_size == UDPBD_PKT_IRREGULAR)
+            DelayThread(1000);
+        cmdid = _udpbd_read_repair(cmdid);
+        if (cmdid < 0)
+            goto error;
+        window[head] = cmdid;
     }
 
-    M_DEBUG("%s(%d, %d): ERROR\n", __func__, (uint32_t)sector, count);
-    g_errno = 0;
+    return count;
+
+error:
+    M_DEBUG("%s: too many errors, disconnecting\n", __func__);
+    for (cmdid = 0; cmdid < 8; cmdid++)
+        g_rd[cmdid].state = UDPBD_RD_FREE;
+    bdm_disconnect_bd(&g_udpbd);
+    bdm_connected = 0;
     return -EIO;
 }
 
+static int udpbd_write(struct block_device *bd, uint64_t sector, const void *buffer, uint16_t count)
+{
+    uint16_t count_left = count;
+
+    M_DEBUG("%s: sector=%d, count=%d\n", __func__, (uint32_t)sector, count);
+
+    if (bdm_connected == 0)
+        return -EIO;
+
+    // Keep up to UDPBD_WRITE_WINDOW write commands in flight, then wait
+    // for all of them: an error is reported by the write that caused it.
+    while (count_left > 0) {
+        struct udpbd_wr *wr;
+
+        // Make room in the window
+        if (g_wr_count == UDPBD_WRITE_WINDOW) {
+            if (_udpbd_write_wait() < 0)
+                return _udpbd_write_fail();
+        }
+
+        wr = &g_wr[(g_wr_head + g_wr_count) % UDPBD_WRITE_WINDOW];
+        wr->sector = sector;
+        wr->count = count_left > UDPBD_WRITE_CHUNK ? UDPBD_WRITE_CHUNK : count_left;
+        wr->data = buffer;
+        g_wr_count++;
+
+        // A failed send is handled like a lost packet
+        _udpbd_write_send(wr);
+
+        count_left -= wr->count;
+        sector += wr->count;
+        buffer = (const uint8_t *)buffer + wr->count * 512;
+    }
+
+    if (_udpbd_write_flush() < 0)
+        return -EIO;
+
+    return count;
+}
+
 static void udpbd_flush(struct block_device *bd)
 {
     M_DEBUG("%s\n", __func__);
@@ -282,11 +624,30 @@ static int udpbd_stop(struct block_device *bd)
     return 0;
 }
 
-static inline void _cmd_info_reply(struct SUDPBDv2_Header *hdr)
+static inline void _cmd_info_reply(struct SUDPBDv2_Header *hdr, uint16_t pointer)
 {
     if (bdm_connected == 0)
     {
         USE_SMAP_REGS;
+        uint32_t frame[8]; // Ethernet + IP header
+        uint8_t *pframe = (uint8_t *)frame;
+        uint32_t ip;
+        int i;
+
+        // Learn the server addresses, so all other packets can be unicast
+        SMAP_REG16(SMAP_R_RXFIFO_RD_PTR) = pointer + 4;
+        for (i = 1; i < 8; i++)
+            frame[i] = SMAP_REG32(SMAP_R_RXFIFO_DATA);
+        ip = IP_ADDR(pframe[26], pframe[27], pframe[28], pframe[29]);
+        if (g_server_fixed && ip != g_server_ip) {
+            M_DEBUG("%s: ignoring server %d.%d.%d.%d\n", __func__, pframe[26], pframe[27], pframe[28], pframe[29]);
+            return;
+        }
+        arp_add_entry(ip, &pframe[6]);
+        g_server_ip = ip;
+        M_DEBUG("%s: server %d.%d.%d.%d\n", __func__, pframe[26], pframe[27], pframe[28], pframe[29]);
+
+        SMAP_REG16(SMAP_R_RXFIFO_RD_PTR) = pointer + 0x2C;
         g_udpbd.sectorSize  = SMAP_REG32(SMAP_R_RXFIFO_DATA);
         g_udpbd.sectorCount = SMAP_REG32(SMAP_R_RXFIFO_DATA);
         bdm_connected = 1;
@@ -298,47 +659,81 @@ static inline void _cmd_read_rdma(struct SUDPBDv2_Header *hdr)
 {
     USE_SMAP_REGS;
     union block_type bt;
-    uint32_t size;
+    uint32_t size, block_size, pkt_size, offset;
+    struct udpbd_rd *rd = &g_rd[hdr->cmdid];
 
     bt.bt = SMAP_REG32(SMAP_R_RXFIFO_DATA);
-    size = bt.block_count << (bt.block_shift + 2);
+    block_size = 1U << (bt.block_shift + 2);
+    size = bt.block_count * block_size;
 
-    if (g_buffer == NULL) {
+    if (rd->state != UDPBD_RD_BUSY) {
         M_DEBUG("%s: unexpected packet (cmd %d, cmdid %d, cmdpkt %d)\n", __func__, hdr->cmd, hdr->cmdid, hdr->cmdpkt);
         return;
     }
 
-    // Validate packet order
-    if (hdr->cmdpkt != (g_read_cmdpkt & 0xff))
-    {
-        // Error, wakeup caller
-        g_read_size = 0;
-        g_errno     = 2;
-        M_DEBUG("%s: invalid cmdpkt (cmd %d, cmdid %d, cmdpkt %d != %d)\n", __func__, hdr->cmd, hdr->cmdid, hdr->cmdpkt, g_read_cmdpkt);
-        SetEventFlag(g_ev_done, 2);
+    // Drop duplicates
+    if (rd->pkt_map[hdr->cmdpkt / 32] & (1U << (hdr->cmdpkt % 32)))
         return;
-    }
-    g_read_cmdpkt++;
 
-    // Validate packet data size
-    if (size > RDMA_MAX_PAYLOAD)
+    // The server fills every packet but the last, so the offset of a
+    // packet follows from its number and block size. This places
+    // packets arriving out of order.
+    pkt_size = (RDMA_MAX_PAYLOAD / block_size) * block_size;
+    if (hdr->cmdpkt == rd->cmdpkt)
+        offset = rd->offset_next;
+    else if (rd->pkt_size != UDPBD_PKT_IRREGULAR)
+        offset = (hdr->cmdpkt - 1) * pkt_size;
+    else
+        offset = rd->size; // Can't place it, invalid
+
+    // Validate packet number and data size
+    if (hdr->cmdpkt == 0 || size > RDMA_MAX_PAYLOAD || (offset + size) > rd->size)
     {
         // Error, wakeup caller
-        g_read_size = 0;
-        g_errno     = 3;
-        M_DEBUG("%s: invalid size %d\n", __func__, size);
-        SetEventFlag(g_ev_done, 2);
+        rd->state = UDPBD_RD_ERROR;
+        M_DEBUG("%s: invalid packet (cmdid %d, cmdpkt %d, size %d)\n", __func__, hdr->cmdid, hdr->cmdpkt, size);
+        SetEventFlag(g_ev_done, 1);
         return;
     }
 
+    // Round trip time: from when the server could start on the command,
+    // after the commands before it, to its first packet
+    if (rd->size_left == rd->size) {
+        rd->first_clk = GetSystemTimeLow();
+        if (!rd->retransmit) {
+            uint32_t start = ((int32_t)(g_last_done_clk - rd->sent_clk) > 0) ? g_last_done_clk : rd->sent_clk;
+            _udpbd_rtt_sample(_udpbd_clk2usec(rd->first_clk - start));
+        }
+    }
+
     // Directly DMA the packet data into the user buffer
-    dev9DmaTransfer(1, g_buffer_act, bt.block_count << 16 | (1U << bt.block_shift), DMAC_TO_MEM);
+    dev9DmaTransfer(1, rd->buffer + offset, bt.block_count << 16 | (1U << bt.block_shift), DMAC_TO_MEM);
+
+    rd->pkt_map[hdr->cmdpkt / 32] |= 1U << (hdr->cmdpkt % 32);
+    if (rd->pkt_size != UDPBD_PKT_IRREGULAR)
+        rd->pkt_size = ((offset + size) < rd->size && size != pkt_size) ? UDPBD_PKT_IRREGULAR : pkt_size;
+    if (hdr->cmdpkt >= rd->cmdpkt) {
+        rd->cmdpkt = hdr->cmdpkt + 1;
+        rd->offset_next = offset + size;
+    }
 
-    g_buffer_act += size;
-    g_read_size -= size;
-    if (g_read_size == 0)
+    rd->size_left -= size;
+    if (rd->size_left == 0)
     {
         // Done, wakeup caller
+        rd->state = UDPBD_RD_DONE;
+        g_last_done_clk = GetSystemTimeLow();
+        if (!rd->retransmit && rd->count >= UDPBD_READ_SAMPLE_MIN)
+            _udpbd_sector_sample(_udpbd_clk2usec(g_last_done_clk - rd->first_clk) / rd->count);
+        SetEventFlag(g_ev_done, 1);
+        return;
+    }
+
+    if ((offset + size) == rd->size)
+    {
+        // Last packet, but some are missing: wakeup caller to get them
+        rd->state = UDPBD_RD_INCOMPLETE;
+        g_last_done_clk = GetSystemTimeLow();
         SetEventFlag(g_ev_done, 1);
         return;
     }
@@ -348,10 +743,19 @@ static inline void _cmd_write_done(struct SUDPBDv2_Header *hdr)
 {
     USE_SMAP_REGS;
     int32_t result = SMAP_REG32(SMAP_R_RXFIFO_DATA);
+    int i;
+
+    for (i = 0; i < g_wr_count; i++) {
+        struct udpbd_wr *wr = &g_wr[(g_wr_head + i) % UDPBD_WRITE_WINDOW];
+        if (wr->state == UDPBD_RD_BUSY && wr->cmdid == hdr->cmdid) {
+            // Done, wakeup caller
+            wr->state = (result >= 0) ? UDPBD_RD_DONE : UDPBD_RD_ERROR;
+            SetEventFlag(g_ev_done, 1);
+            return;
+        }
+    }
 
-    // Done, wakeup caller
-    SetEventFlag(g_ev_done, (result >= 0) ? 1 : 2);
-    return;
+    M_DEBUG("%s: unexpected packet (cmdid %d)\n", __func__, hdr->cmdid);
 }
 
 static int udpbd_isr(udp_socket_t *socket, uint16_t pointer, void *arg)
@@ -362,7 +766,8 @@ static int udpbd_isr(udp_socket_t *socket, uint16_t pointer, void *arg)
     SMAP_REG16(SMAP_R_RXFIFO_RD_PTR) = pointer + 0x28;
     hdr32.cmd32 = SMAP_REG32(SMAP_R_RXFIFO_DATA);
 
-    if (hdr32.hdr.cmdid != g_cmdid) {
+    // Read and write commands can be in flight with any cmdid
+    if (hdr32.hdr.cmd != UDPBD_CMD_READ_RDMA && hdr32.hdr.cmd != UDPBD_CMD_WRITE_DONE && hdr32.hdr.cmdid != g_cmdid) {
         M_DEBUG("%s: unexpected packet (cmd %d, cmdid %d, cmdpkt %d)\n", __func__, hdr32.hdr.cmd, hdr32.hdr.cmdid, hdr32.hdr.cmdpkt);
         return 0;
     }
@@ -370,7 +775,7 @@ static int udpbd_isr(udp_socket_t *socket, uint16_t pointer, void *arg)
     switch (hdr32.hdr.cmd)
     {
         case UDPBD_CMD_INFO_REPLY:
-            _cmd_info_reply(&hdr32.hdr);
+            _cmd_info_reply(&hdr32.hdr, pointer);
             break;
         case UDPBD_CMD_READ_RDMA:
             _cmd_read_rdma(&hdr32.hdr);
@@ -388,6 +793,17 @@ static int udpbd_isr(udp_socket_t *socket, uint16_t pointer, void *arg)
 //
 // Public functions
 //
+const struct udpbd_stats *udpbd_get_stats(void)
+{
+    return &g_stats;
+}
+
+void udpbd_set_server_ip(uint32_t ip)
+{
+    g_server_ip = ip;
+    g_server_fixed = 1;
+}
+
 int udpbd_init(void)
 {
     udpbd_pkt_t pkt;
@@ -401,6 +817,9 @@ int udpbd_init(void)
     if (g_ev_done <= 0)
         g_ev_done = CreateEventFlag(&EventFlagData);
 
+    memset(&g_stats, 0, sizeof(g_stats));
+    g_stats.rto = UDPBD_RTO_INIT;
+
     g_udpbd.name         = "udp";
     g_udpbd.devNr        = 0;
     g_udpbd.parNr        = 0;
@@ -414,8 +833,9 @@ int udpbd_init(void)
     // Bind to UDP socket
     udpbd_socket = udp_bind(UDPBD_CLIENT_PORT, udpbd_isr, NULL);
 
-    // Broadcast request for block device information
-    udp_packet_init((udp_packet_t *)&pkt, IP_ADDR(255,255,255,255), UDPBD_SERVER_PORT);
+    // Request block device information, broadcast to find the server if
+    // it is not known yet
+    udp_packet_init((udp_packet_t *)&pkt, g_server_ip, UDPBD_SERVER_PORT);
     pkt.bd.cmd    = UDPBD_CMD_INFO;
     pkt.bd.cmdid  = g_cmdid;
     pkt.bd.cmdpkt = 0;
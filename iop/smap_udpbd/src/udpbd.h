@@ -100,6 +100,10 @@ union block_type
  * - 128 *  11 = 1408 bytes <- default
  * - 256 *   5 = 1280 bytes
  * - 512 *   2 = 1024 bytes
+ *
+ * All packets of a transfer, except the last, carry the maximum payload
+ * for their block size. The client uses this to place packets that
+ * arrive out of order, and to re-read only the sectors of lost packets.
  */
 #define UDP_MAX_PAYLOAD  1472
 #define RDMA_MAX_PAYLOAD (UDP_MAX_PAYLOAD - sizeof(struct SUDPBDv2_Header) - sizeof(union block_type)) // 1466
@@ -111,7 +115,23 @@ struct SUDPBDv2_RDMA {
 } __attribute__((__packed__));
 
 
+/*
+ * Client statistics
+ */
+struct udpbd_stats {
+    uint32_t rtt;         // Last measured round trip time, usec
+    uint32_t srtt;        // Smoothed round trip time, usec
+    uint32_t rttvar;      // Round trip time variation, usec
+    uint32_t rto;         // Current read timeout, usec
+    uint32_t timeouts;    // Commands that timed out
+    uint32_t retransmits; // Commands sent again, completely or partially
+    uint32_t sector_usec; // Smoothed transfer time of one read sector, usec
+};
+
+
 int udpbd_init(void);
+const struct udpbd_stats *udpbd_get_stats(void);
+void udpbd_set_server_ip(uint32_t ip);
 
 
 #endif